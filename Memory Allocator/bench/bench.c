@@ -0,0 +1,369 @@
+/*
+ * Allocator benchmark - runs one synthetic trace against Mem_Alloc or glibc malloc
+ * and reports the time per operation, the peak RSS and the fragmentation at the end
+ *
+ * usage: bench [-a mem|glibc] [-p best|first|next|good] [-r region] [-n ops] [-t pairs] [-s seed] [-o trace] pattern
+ *   -o  records the allocations of the pattern into a trace for replay
+ * patterns:
+ *   lifo     - batches of allocations freed in the reverse order
+ *   fifo     - a window of allocations, the oldest one is freed first
+ *   random   - random sizes allocated and freed at random
+ *   prodcons - pairs of threads, one allocating and the other freeing
+ *   realloc  - buffers growing step by step, then freed
+ *
+ * Every pattern runs in a process of its own since Mem_Init can only be called once
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "mem.h"
+
+static int use_glibc = 0;
+static long ops = 200000;
+static int pairs = 2;
+static uint64_t seed = 1;
+
+static void* bench_alloc(size_t size) {
+   return use_glibc ? malloc(size) : Mem_Alloc(size);
+}
+
+static void bench_free(void* ptr) {
+   if (use_glibc)
+      free(ptr);
+   else
+      Mem_Free(ptr);
+}
+
+static void* bench_realloc(void* ptr, size_t size) {
+   return use_glibc ? realloc(ptr, size) : Mem_Realloc(ptr, size);
+}
+
+// xorshift, so every run of a pattern sees the same sizes
+static uint64_t next_random(uint64_t* state) {
+   *state ^= *state << 13;
+   *state ^= *state >> 7;
+   *state ^= *state << 17;
+   return *state;
+}
+
+static size_t random_size(uint64_t* state, size_t min, size_t max) {
+   return min + next_random(state) % (max - min + 1);
+}
+
+static uint64_t now_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* Time of every single operation, in ns */
+typedef struct samples {
+   uint32_t* ns;
+   long count;
+   long capacity;
+   long failed;
+} samples;
+
+static void samples_init(samples* s, long capacity) {
+   s->ns = malloc(capacity * sizeof(uint32_t));
+   assert(s->ns != NULL);
+   s->count = 0;
+   s->capacity = capacity;
+   s->failed = 0;
+}
+
+static inline void record(samples* s, uint64_t start) {
+   if (s->count < s->capacity)
+      s->ns[s->count++] = (uint32_t)(now_ns() - start);
+}
+
+// timed wrappers
+static void* timed_alloc(samples* s, size_t size) {
+   uint64_t start = now_ns();
+   void* ptr = bench_alloc(size);
+   record(s, start);
+   if (ptr == NULL)
+      s->failed++;
+   else
+      memset(ptr, 0, size < 64 ? size : 64);
+   return ptr;
+}
+
+static void timed_free(samples* s, void* ptr) {
+   uint64_t start;
+   if (ptr == NULL)
+      return;
+   start = now_ns();
+   bench_free(ptr);
+   record(s, start);
+}
+
+/* Patterns - each one performs about 'ops' timed operations */
+
+#define LIFO_BATCH 1000
+#define FIFO_WINDOW 1000
+#define RANDOM_SLOTS 4096
+#define REALLOC_BUFFERS 64
+#define REALLOC_LIMIT (64 * 1024)
+
+static void run_lifo(samples* s, void** live, long* live_count) {
+   void* batch[LIFO_BATCH];
+   uint64_t state = seed;
+   long done = 0;
+   int i;
+
+   while (done < ops) {
+      for (i = 0; i < LIFO_BATCH; i++)
+         batch[i] = timed_alloc(s, random_size(&state, 16, 512));
+      for (i = LIFO_BATCH - 1; i >= 0; i--)
+         timed_free(s, batch[i]);
+      done += 2 * LIFO_BATCH;
+   }
+   *live_count = 0;
+   (void)live;
+}
+
+static void run_fifo(samples* s, void** live, long* live_count) {
+   uint64_t state = seed;
+   long done;
+
+   for (done = 0; done < ops / 2; done++) {
+      long slot = done % FIFO_WINDOW;
+      if (done >= FIFO_WINDOW)
+         timed_free(s, live[slot]);
+      live[slot] = timed_alloc(s, random_size(&state, 16, 512));
+   }
+   *live_count = FIFO_WINDOW;
+}
+
+static void run_random(samples* s, void** live, long* live_count) {
+   uint64_t state = seed;
+   long done;
+
+   for (done = 0; done < ops; done++) {
+      long slot = next_random(&state) % RANDOM_SLOTS;
+      if (live[slot] != NULL) {
+         timed_free(s, live[slot]);
+         live[slot] = NULL;
+      }
+      else {
+         // mostly small objects with a tail of bigger ones
+         size_t size = next_random(&state) % 8 == 0 ? random_size(&state, 512, 16384) : random_size(&state, 8, 256);
+         live[slot] = timed_alloc(s, size);
+      }
+   }
+   *live_count = RANDOM_SLOTS;
+}
+
+static void run_realloc(samples* s, void** live, long* live_count) {
+   size_t size[REALLOC_BUFFERS] = {0};
+   uint64_t state = seed;
+   long done;
+
+   for (done = 0; done < ops; done++) {
+      int i = next_random(&state) % REALLOC_BUFFERS;
+      uint64_t start;
+      void* ptr;
+
+      if (size[i] >= REALLOC_LIMIT) {
+         timed_free(s, live[i]);
+         live[i] = NULL;
+         size[i] = 0;
+         continue;
+      }
+      // grow by a quarter, at least 16 bytes, like a vector
+      size[i] += size[i] / 4 > 16 ? size[i] / 4 : 16;
+      start = now_ns();
+      ptr = bench_realloc(live[i], size[i]);
+      record(s, start);
+      if (ptr == NULL) {
+         s->failed++;
+         bench_free(live[i]);
+         size[i] = 0;
+      }
+      live[i] = ptr;
+   }
+   *live_count = REALLOC_BUFFERS;
+}
+
+/* Producer/consumer - each pair shares a single producer single consumer ring */
+
+#define RING_SIZE 1024
+
+typedef struct ring {
+   void* slots[RING_SIZE];
+   long head;
+   long tail;
+   samples alloc_timing;
+   samples free_timing;
+   uint64_t seed;
+} ring;
+
+static void* producer(void* arg) {
+   ring* r = arg;
+   long done;
+
+   for (done = 0; done < ops / pairs / 2; done++) {
+      void* ptr = timed_alloc(&r->alloc_timing, random_size(&r->seed, 16, 512));
+      if (ptr == NULL)
+         continue;
+      while (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail == RING_SIZE)
+         ;
+      r->slots[r->head % RING_SIZE] = ptr;
+      __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+   }
+   // a NULL marks the end
+   while (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail == RING_SIZE)
+      ;
+   r->slots[r->head % RING_SIZE] = NULL;
+   __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+   return NULL;
+}
+
+static void* consumer(void* arg) {
+   ring* r = arg;
+
+   for (;;) {
+      void* ptr;
+      while (__atomic_load_n(&r->tail, __ATOMIC_RELAXED) == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+         ;
+      ptr = r->slots[r->tail % RING_SIZE];
+      __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+      if (ptr == NULL)
+         break;
+      timed_free(&r->free_timing, ptr);
+   }
+   return NULL;
+}
+
+static void run_prodcons(samples* s, void** live, long* live_count) {
+   pthread_t threads[2 * 64];
+   ring* rings = calloc(pairs, sizeof(ring));
+   int i;
+
+   assert(rings != NULL && pairs <= 64);
+   for (i = 0; i < pairs; i++) {
+      samples_init(&rings[i].alloc_timing, ops / pairs / 2 + 1);
+      samples_init(&rings[i].free_timing, ops / pairs / 2 + 1);
+      rings[i].seed = seed + i;
+      pthread_create(&threads[2 * i], NULL, producer, &rings[i]);
+      pthread_create(&threads[2 * i + 1], NULL, consumer, &rings[i]);
+   }
+   for (i = 0; i < pairs; i++) {
+      pthread_join(threads[2 * i], NULL);
+      pthread_join(threads[2 * i + 1], NULL);
+
+      // merge the timings of both threads
+      memcpy(s->ns + s->count, rings[i].alloc_timing.ns, rings[i].alloc_timing.count * sizeof(uint32_t));
+      s->count += rings[i].alloc_timing.count;
+      s->failed += rings[i].alloc_timing.failed;
+      memcpy(s->ns + s->count, rings[i].free_timing.ns, rings[i].free_timing.count * sizeof(uint32_t));
+      s->count += rings[i].free_timing.count;
+      free(rings[i].alloc_timing.ns);
+      free(rings[i].free_timing.ns);
+   }
+   free(rings);
+   *live_count = 0;
+   (void)live;
+}
+
+static int compare_ns(const void* a, const void* b) {
+   uint32_t left = *(const uint32_t*)a;
+   uint32_t right = *(const uint32_t*)b;
+   return left < right ? -1 : left > right;
+}
+
+static uint32_t percentile(samples* s, double p) {
+   long index = (long)(p * (s->count - 1));
+   return s->count == 0 ? 0 : s->ns[index];
+}
+
+int main(int argc, char* argv[]) {
+   static const char* policies[] = {"best", "first", "next", "good"};
+   static const int policy_values[] = {MEM_BEST_FIT, MEM_FIRST_FIT, MEM_NEXT_FIT, MEM_GOOD_FIT};
+   size_t region = 64 << 20;
+   const char* policy = "best";
+   const char* trace = NULL;
+   const char* pattern;
+   void (*run)(samples*, void**, long*);
+   struct rusage usage;
+   samples s;
+   void** live;
+   long live_count = 0;
+   long i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "a:p:r:n:t:s:o:")) != -1) {
+      switch (opt) {
+      case 'a': use_glibc = strcmp(optarg, "glibc") == 0; break;
+      case 'p': policy = optarg; break;
+      case 'r': region = strtoull(optarg, NULL, 0); break;
+      case 'n': ops = atol(optarg); break;
+      case 't': pairs = atoi(optarg); break;
+      case 's': seed = strtoull(optarg, NULL, 0); break;
+      case 'o': trace = optarg; break;
+      default:
+         fprintf(stderr, "usage: %s [-a mem|glibc] [-p best|first|next|good] [-r region] [-n ops] [-t pairs] [-s seed] [-o trace] pattern\n", argv[0]);
+         return 1;
+      }
+   }
+   if (optind != argc - 1 || ops <= 0 || pairs <= 0 || pairs > 64 || seed == 0 || (trace != NULL && use_glibc)) {
+      fprintf(stderr, "usage: %s [-a mem|glibc] [-p best|first|next|good] [-r region] [-n ops] [-t pairs] [-s seed] [-o trace] pattern\n", argv[0]);
+      return 1;
+   }
+   pattern = argv[optind];
+   if (strcmp(pattern, "lifo") == 0) run = run_lifo;
+   else if (strcmp(pattern, "fifo") == 0) run = run_fifo;
+   else if (strcmp(pattern, "random") == 0) run = run_random;
+   else if (strcmp(pattern, "prodcons") == 0) run = run_prodcons;
+   else if (strcmp(pattern, "realloc") == 0) run = run_realloc;
+   else {
+      fprintf(stderr, "unknown pattern %s\n", pattern);
+      return 1;
+   }
+
+   if (!use_glibc) {
+      if (Mem_Init(region) != 0)
+         return 1;
+      for (i = 0; i < 4 && strcmp(policy, policies[i]) != 0; i++)
+         ;
+      if (i == 4 || Mem_SetPolicy(policy_values[i]) != 0) {
+         fprintf(stderr, "unknown policy %s\n", policy);
+         return 1;
+      }
+   }
+
+   samples_init(&s, 2 * ops + 2 * LIFO_BATCH);
+   live = calloc(RANDOM_SLOTS, sizeof(void*));
+   assert(live != NULL);
+   if (trace != NULL && Mem_TraceStart(trace, s.capacity) != 0)
+      return 1;
+   run(&s, live, &live_count);
+   if (trace != NULL)
+      Mem_TraceStop();
+
+   // fragmentation with the objects of the trace still live
+   char frag[16] = "n/a";
+   if (!use_glibc) {
+      struct mem_stats stats;
+      Mem_GetStats(&stats);
+      if (stats.bytes_free != 0)
+         snprintf(frag, sizeof(frag), "%.1f%%", 100.0 * (stats.bytes_free - stats.largest_free) / stats.bytes_free);
+   }
+   for (i = 0; i < live_count; i++)
+      bench_free(live[i]);
+
+   getrusage(RUSAGE_SELF, &usage);
+   qsort(s.ns, s.count, sizeof(uint32_t), compare_ns);
+   printf("%-9s %-6s %-6s ops=%-8ld failed=%-6ld p50=%-6u p90=%-6u p99=%-6u max=%-8u rss=%ldkB frag=%s\n",
+          pattern, use_glibc ? "glibc" : "mem", use_glibc ? "-" : policy, s.count, s.failed,
+          percentile(&s, 0.5), percentile(&s, 0.9), percentile(&s, 0.99), percentile(&s, 1.0),
+          usage.ru_maxrss, frag);
+   return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * Trace replay - feeds a trace recorded with Mem_TraceStart (or bench -o) through
+ * Mem_Alloc with any placement policy and heap size, or through glibc malloc,
+ * and reports the time per operation, the peak RSS and the fragmentation at the end
+ *
+ * usage: replay [-a mem|glibc] [-p best|first|next|good] [-r region] [-g] trace
+ *   -g  start with a growable heap
+ *
+ * The events of all threads are replayed by a single thread in the order of their
+ * timestamps, so the timings leave out lock contention
+ * Frees and reallocations of pointers allocated before the trace started are skipped
+ */
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "mem.h"
+
+static int use_glibc = 0;
+
+static uint64_t now_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* Pointers of the trace mapped to the pointers of the replay - linear probing */
+typedef struct live_map {
+   uint64_t* keys;
+   void** values;
+   size_t mask;
+   long count;
+} live_map;
+
+static void map_init(live_map* map, size_t events) {
+   size_t size = 16;
+   while (size < 2 * events)
+      size *= 2;
+   map->keys = calloc(size, sizeof(uint64_t));
+   map->values = calloc(size, sizeof(void*));
+   assert(map->keys != NULL && map->values != NULL);
+   map->mask = size - 1;
+   map->count = 0;
+}
+
+static size_t map_slot(live_map* map, uint64_t key) {
+   size_t slot = (key * 0x9E3779B97F4A7C15ull >> 20) & map->mask;
+   while (map->keys[slot] != 0 && map->keys[slot] != key)
+      slot = (slot + 1) & map->mask;
+   return slot;
+}
+
+static void map_put(live_map* map, uint64_t key, void* value) {
+   size_t slot = map_slot(map, key);
+   if (map->keys[slot] == 0)
+      map->count++;
+   map->keys[slot] = key;
+   map->values[slot] = value;
+}
+
+// removes 'key' and returns its value, NULL if the trace never allocated it
+static void* map_take(live_map* map, uint64_t key) {
+   size_t slot = map_slot(map, key);
+   size_t next;
+   void* value = map->values[slot];
+
+   if (map->keys[slot] == 0)
+      return NULL;
+   map->count--;
+   // shift the entries behind the slot back, so no probe sequence is cut short
+   for (next = (slot + 1) & map->mask; map->keys[next] != 0; next = (next + 1) & map->mask) {
+      size_t home = (map->keys[next] * 0x9E3779B97F4A7C15ull >> 20) & map->mask;
+      if (((next - home) & map->mask) >= ((next - slot) & map->mask)) {
+         map->keys[slot] = map->keys[next];
+         map->values[slot] = map->values[next];
+         slot = next;
+      }
+   }
+   map->keys[slot] = 0;
+   map->values[slot] = NULL;
+   return value;
+}
+
+// orders the events by time, events with the same time stay in file order
+static int compare_events(const void* a, const void* b) {
+   const struct mem_trace_event* left = *(const struct mem_trace_event* const*)a;
+   const struct mem_trace_event* right = *(const struct mem_trace_event* const*)b;
+   if (left->time != right->time)
+      return left->time < right->time ? -1 : 1;
+   return left < right ? -1 : left > right;
+}
+
+static int compare_ns(const void* a, const void* b) {
+   uint32_t left = *(const uint32_t*)a;
+   uint32_t right = *(const uint32_t*)b;
+   return left < right ? -1 : left > right;
+}
+
+static uint32_t percentile(uint32_t* ns, long count, double p) {
+   return count == 0 ? 0 : ns[(long)(p * (count - 1))];
+}
+
+int main(int argc, char* argv[]) {
+   static const char* policies[] = {"best", "first", "next", "good"};
+   static const int policy_values[] = {MEM_BEST_FIT, MEM_FIRST_FIT, MEM_NEXT_FIT, MEM_GOOD_FIT};
+   size_t region = 64 << 20;
+   const char* policy = "best";
+   const struct mem_trace_header* header;
+   const struct mem_trace_event** order;
+   struct rusage usage;
+   struct stat st;
+   live_map live;
+   uint32_t* ns;
+   long count, i, failed = 0, skipped = 0, timed = 0;
+   int growable = 0;
+   int opt, fd;
+
+   while ((opt = getopt(argc, argv, "a:p:r:g")) != -1) {
+      switch (opt) {
+      case 'a': use_glibc = strcmp(optarg, "glibc") == 0; break;
+      case 'p': policy = optarg; break;
+      case 'r': region = strtoull(optarg, NULL, 0); break;
+      case 'g': growable = 1; break;
+      default:
+         fprintf(stderr, "usage: %s [-a mem|glibc] [-p best|first|next|good] [-r region] [-g] trace\n", argv[0]);
+         return 1;
+      }
+   }
+   if (optind != argc - 1) {
+      fprintf(stderr, "usage: %s [-a mem|glibc] [-p best|first|next|good] [-r region] [-g] trace\n", argv[0]);
+      return 1;
+   }
+
+   fd = open(argv[optind], O_RDONLY);
+   if (fd == -1 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header)) {
+      fprintf(stderr, "cannot read trace %s\n", argv[optind]);
+      return 1;
+   }
+   header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (header == MAP_FAILED || memcmp(header->magic, MEM_TRACE_MAGIC, 8) != 0 ||
+       header->version != MEM_TRACE_VERSION || header->event_size != sizeof(struct mem_trace_event)) {
+      fprintf(stderr, "%s is not a trace of this version\n", argv[optind]);
+      return 1;
+   }
+   count = (st.st_size - sizeof(*header)) / sizeof(struct mem_trace_event);
+
+   // the threads were written in batches, put the events back in program order
+   order = malloc((count + 1) * sizeof(*order));
+   assert(order != NULL);
+   for (i = 0; i < count; i++)
+      order[i] = (const struct mem_trace_event*)(header + 1) + i;
+   qsort(order, count, sizeof(*order), compare_events);
+
+   if (!use_glibc) {
+      if ((growable ? Mem_InitGrowable(region) : Mem_Init(region)) != 0)
+         return 1;
+      for (i = 0; i < 4 && strcmp(policy, policies[i]) != 0; i++)
+         ;
+      if (i == 4 || Mem_SetPolicy(policy_values[i]) != 0) {
+         fprintf(stderr, "unknown policy %s\n", policy);
+         return 1;
+      }
+   }
+   map_init(&live, count);
+   ns = malloc((count + 1) * sizeof(uint32_t));
+   assert(ns != NULL);
+
+   for (i = 0; i < count; i++) {
+      const struct mem_trace_event* event = order[i];
+      uint64_t start;
+      void *ptr, *old;
+
+      switch (event->op) {
+      case MEM_TRACE_ALLOC:
+         start = now_ns();
+         ptr = use_glibc ? malloc(event->size) : Mem_Alloc(event->size);
+         ns[timed++] = (uint32_t)(now_ns() - start);
+         if (ptr == NULL)
+            failed++;
+         else
+            map_put(&live, event->ptr, ptr);
+         break;
+      case MEM_TRACE_FREE:
+         old = map_take(&live, event->ptr);
+         if (old == NULL) {
+            skipped++;
+            break;
+         }
+         start = now_ns();
+         if (use_glibc)
+            free(old);
+         else
+            Mem_Free(old);
+         ns[timed++] = (uint32_t)(now_ns() - start);
+         break;
+      case MEM_TRACE_REALLOC:
+         old = map_take(&live, event->old);
+         if (old == NULL)
+            skipped++;
+         start = now_ns();
+         ptr = use_glibc ? realloc(old, event->size) : Mem_Realloc(old, event->size);
+         ns[timed++] = (uint32_t)(now_ns() - start);
+         if (ptr == NULL) {
+            // the old block is still there, keep it under the name of the result
+            failed++;
+            ptr = old;
+         }
+         if (ptr != NULL)
+            map_put(&live, event->ptr, ptr);
+         break;
+      default:
+         skipped++;
+         break;
+      }
+   }
+
+   // fragmentation with the objects of the trace still live
+   char frag[16] = "n/a";
+   if (!use_glibc) {
+      struct mem_stats stats;
+      Mem_GetStats(&stats);
+      if (stats.bytes_free != 0)
+         snprintf(frag, sizeof(frag), "%.1f%%", 100.0 * (stats.bytes_free - stats.largest_free) / stats.bytes_free);
+   }
+
+   getrusage(RUSAGE_SELF, &usage);
+   qsort(ns, timed, sizeof(uint32_t), compare_ns);
+   printf("%-9s %-6s %-6s ops=%-8ld failed=%-6ld skipped=%-6ld live=%-6ld p50=%-6u p90=%-6u p99=%-6u max=%-8u rss=%ldkB frag=%s dropped=%llu\n",
+          argv[optind], use_glibc ? "glibc" : "mem", use_glibc ? "-" : policy, timed, failed, skipped, live.count,
+          percentile(ns, timed, 0.5), percentile(ns, timed, 0.9), percentile(ns, timed, 0.99),
+          percentile(ns, timed, 1.0), usage.ru_maxrss, frag, (unsigned long long)header->dropped);
+   return 0;
+}
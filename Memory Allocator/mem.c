@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -5,6 +6,12 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <stddef.h>
 #include "mem.h"
 #include "stdlib.h"
 
@@ -15,10 +22,11 @@
  */
 typedef struct block_tag{
 
-  int size_status;
+  size_t size_status;
   
  /*
-  * Size of the block is always a multiple of 4
+  * Size of the block is always a multiple of MEM_ALIGN, by default the size of a
+  * block_tag (4 bytes in the 32-bit build, 8 bytes in the 64-bit build)
   * => last two bits are always zero - can be used to store other information
   *
   * LSB -> Least Significant Bit (Last Bit)
@@ -29,10 +37,17 @@ typedef struct block_tag{
   * SLB = 1 => previous block is allocated/busy
   * 
   * When used as the footer the last two bits should be zero
+  *
+  * Busy blocks never carry a footer, their payload runs up to the next header
+  * The size of a block is only needed from behind when the block is free
+  * (to coalesce it with the block after it), and SLB of the next header
+  * tells whether that is the case, so SLB must always be kept correct
+  * The per block overhead of a busy block is its header plus the rounding
+  * up to MEM_ALIGN and to MIN_BLOCK_SIZE
   */
 
  /*
-  * Examples:
+  * Examples (32-bit build):
   * 
   * For a busy block with a payload of 24 bytes (i.e. 24 bytes data + an additional 4 bytes for header)  
   * Header:
@@ -50,273 +65,4295 @@ typedef struct block_tag{
 
 } block_tag;
 
-/* Global variable - This will always point to the first block
- * i.e. the block with the lowest address */
-block_tag *first_block = NULL;
+/*
+ * Free blocks additionally keep the links of their size class bin in the
+ * first bytes of the payload, right after the header
+ * The footer of a free block is still the last block_tag of the block
+ */
+typedef struct free_block{
+
+  block_tag header;
+  struct free_block *next;
+  struct free_block *prev;
 
-/* Global variable - Total available memory */
-int total_mem_size = 0;
+} free_block;
 
 /*
- * Function for allocating 'size' bytes
- * Returns address of the payload in the allocated block on success 
- * Returns NULL on failure 
- * Here is what this function should accomplish 
- * - If size is less than equal to 0 - Return NULL
- * - Round up size to a multiple of 4 
- * - Traverse the list of blocks and allocate the best free block which can accommodate the requested size 
- * - Also, when allocating a block - split it into two blocks when possible 
- * Tips: Be careful with pointer arithmetic 
+ * Free blocks of at least SMALL_BIN_LIMIT bytes are kept in a splay tree
+ * ordered by size instead of a bin, with the tree links after the bin links
+ * Every size is in the tree once, further free blocks of that size are
+ * chained behind the block in the tree through next and prev
+ * prev is NULL for the block in the tree and left and right are only valid there
+ */
+typedef struct tree_block{
+
+  block_tag header;
+  struct tree_block *next;
+  struct tree_block *prev;
+  struct tree_block *left;
+  struct tree_block *right;
+
+} tree_block;
+
+//status bits stored in the low bits of size_status
+#define BUSY 1
+#define PREV_BUSY 2
+#define STATUS_BITS 3
+
+#define HEADER_SIZE sizeof(block_tag)
+
+//block sizes and payload addresses are multiples of this
+//build with -DMEM_ALIGN=16 (or any bigger power of two) to align every payload to 16 bytes
+#ifndef MEM_ALIGN
+#define MEM_ALIGN sizeof(block_tag)
+#endif
+
+#define ALIGN_UP(size, align) (((size) + (align) - 1) & ~((size_t)(align) - 1))
+
+//a free block must be able to hold its header, its bin links and its footer
+#define MIN_BLOCK_SIZE ALIGN_UP(sizeof(free_block) + sizeof(block_tag), MEM_ALIGN)
+
+//the heap never hands out a block bigger than this
+#define MAX_BLOCK_SIZE ((SIZE_MAX >> 1) & ~(size_t)STATUS_BITS)
+
+/*
+ * Free blocks below SMALL_BIN_LIMIT are kept in segregated size class bins,
+ * each holding blocks of exactly one size (multiple of MEM_ALIGN)
+ * Bigger free blocks go into the size tree of the arena
+ */
+#define SIZE_BITS (8 * (int)sizeof(size_t))
+#define SMALL_BIN_LIMIT 256
+#define NUM_BINS (SMALL_BIN_LIMIT / (int)MEM_ALIGN)
+#define BIN_MAP_WORDS ((NUM_BINS + 31) / 32)
+
+/*
+ * Payloads of at most SLAB_MAX_SIZE bytes of the main arena are served from slabs
+ * There is one slab class per multiple of MEM_ALIGN, index 0 is unused
+ */
+#define SLAB_MAX_SIZE 64
+#define SLAB_CLASSES (SLAB_MAX_SIZE / MEM_ALIGN + 1)
+
+typedef struct mem_slab mem_slab;
+
+/*
+ * Freed blocks of at most QUICK_MAX_SIZE bytes can be kept on quick lists, one per multiple of MEM_ALIGN
+ * Hardened builds keep none, the blocks on the lists are still busy and a second free would pass
+ */
+#ifdef MEM_HARDEN
+#define QUICK_MAX_SIZE 0
+#else
+#define QUICK_MAX_SIZE 1024
+#endif
+#define QUICK_LISTS (QUICK_MAX_SIZE / MEM_ALIGN + 1)
+
+/*
+ * A chunk is one contiguous run of blocks
+ * Every chunk ends with an epilogue - a busy header of size 0 - and its first
+ * block has the "previous block busy" bit set, so coalescing never crosses
+ * the edges of a chunk
+ * Chunks added when a growable arena runs out of space keep this structure
+ * at the start of their mapping
+ */
+typedef struct mem_chunk{
+
+  /* This will always point to the first block of the chunk
+   * i.e. the block with the lowest address */
+  block_tag *first_block;
+
+  /* Size of the chunk from first_block on, epilogue included */
+  size_t size;
+
+  /* Chunks of the arena in the order they were added */
+  struct mem_chunk *next;
+  struct mem_chunk *prev;
+
+  /* One bit per page from the page holding first_block on, set for the pages
+   * holding a slab - mapped when the chunk gets its first slab */
+  unsigned char *slab_map;
+
+  /* No block reaching past this was ever handed out, the memory from here on
+   * reads as zeroes apart from the links and footers of the free blocks */
+  char *untouched;
+
+} mem_chunk;
+
+/*
+ * An arena is an independent heap - one mmap'd region with its own block list,
+ * size class bins and lock
+ * Growable arenas map additional chunks when no free block fits
+ * Mem_Init sets up the main arena, Mem_ArenaCreate sets up additional ones
+ */
+struct mem_arena{
+
+  /* The region the arena was created with */
+  mem_chunk first_chunk;
+
+  /* The most recently added chunk, first_chunk if the arena never grew */
+  mem_chunk *last_chunk;
+
+  /* Total available memory, over all chunks */
+  size_t total_mem_size;
+
+  /* Set if the arena maps additional chunks when it runs out of space */
+  int growable;
+
+  /* MEM_INIT_* options the chunks of the arena are mapped with */
+  int map_flags;
+
+  /* NUMA node the chunks are placed on, -1 if they go where they are first touched */
+  int node;
+
+  /* Heads of the free lists, one per size class */
+  free_block *bins[NUM_BINS];
+
+  /* One bit per bin, set when the bin is not empty */
+  unsigned int bin_map[BIN_MAP_WORDS];
+
+  /* Root of the size tree of the free blocks too big for the bins */
+  tree_block *tree;
+
+  /* Placement policy, one of the MEM_*_FIT values, best fit by default */
+  int policy;
+
+  /* Next fit starts its search here, NULL for the first block of the arena
+   * Always the header of a block, epilogues included */
+  block_tag *rover;
+
+  /* Slabs with at least one free slot, one list per slab class */
+  mem_slab *slabs[SLAB_CLASSES];
+
+  /* Bytes freed since the last trim, a trim runs once they reach trim_threshold (0 - never) */
+  size_t trim_pending;
+  size_t trim_threshold;
+
+  /* Busy blocks freed while another thread held the lock, linked through their payloads
+   * Pushed without the lock, the next holder of the lock frees them */
+  void *remote_frees;
+
+  /* Freed blocks waiting to be coalesced, by size, see heap_release
+   * They add up to quick_bytes, the arena is swept once that reaches defer_threshold (0 - off) */
+  block_tag *quick[QUICK_LISTS];
+  size_t quick_bytes;
+  size_t defer_threshold;
+
+  /* Counters for Mem_GetStats, bytes_busy and largest_free are only worked out when asked for */
+  struct mem_stats stats;
+
+  /* Protects the bins and the block list */
+  pthread_mutex_t lock;
+
+};
+
+/* Global variable - The arena set up by Mem_Init, used by Mem_Alloc */
+static mem_arena main_arena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*
+ * Persistent heaps, set up with Mem_InitFile
+ * The file starts with a superblock, the heap fills the rest of it
+ * Free lists and block links are plain pointers, so the file is always mapped at
+ * the address it was created at, and reopening only copies the state of the main
+ * arena back from the superblock - nothing in the heap is looked at or rebuilt
+ * The superblock holds that state as of the last Mem_SyncFile, 'clean' tells if the
+ * heap has not changed since, a heap that was not synced after its last change is
+ * not reopened
+ * Thread caches, slabs and huge blocks keep memory outside of the file, none of
+ * them are used with a persistent heap
+ */
+#define MEM_FILE_MAGIC "MEMHEAP"
+#define MEM_SHM_MAGIC "MEMSHM"
+#define MEM_FILE_VERSION 1
+
+//map_flags of arenas in a file or in shared memory, trimming them does not clear their pages
+#define MEM_MAP_SHARED 0x10000
+
+//block layout of the build, MEM_ALIGN and whether blocks carry canaries
+#ifdef MEM_HARDEN
+#define MEM_FILE_LAYOUT (MEM_ALIGN | 0x80000000u)
+#else
+#define MEM_FILE_LAYOUT MEM_ALIGN
+#endif
+
+typedef struct file_super{
+
+  char magic[8];              /* MEM_FILE_MAGIC */
+  uint32_t version;
+  uint32_t layout;            /* MEM_FILE_LAYOUT of the build that created the file */
+  uint64_t arena_size;        /* sizeof(mem_arena) of the build that created the file */
+  uint64_t base;              /* address the file is mapped at */
+  uint64_t size;              /* size of the file */
+  uint64_t root;              /* set by Mem_SetFileRoot */
+  uint32_t clean;             /* set if 'arena' matches the heap */
+  mem_arena arena;            /* the main arena as of the last sync, the arena itself in shared memory */
+
+} file_super;
+
+static struct{
+
+  file_super *super;          /* NULL unless the main arena is in a file */
+
+} persist;
+
+/*
+ * Address range table used by Mem_Free to find the arena and chunk owning a pointer
+ * There is one entry per chunk, sorted by address, so a lookup is a binary search
+ * Writers change the table under region_lock between two increments of region_seq,
+ * readers take no lock and search again if region_seq was odd or has moved on
+ * All arenas share the MEM_MAX_REGIONS entries, see mem.h - a growable arena
+ * at least doubles with each chunk, so it never holds more than a few dozen
+ */
+typedef struct arena_region{
+
+  char *start;
+  char *end;
+  mem_chunk *chunk;
+  mem_arena *arena;
+
+} arena_region;
+
+static arena_region regions[MEM_MAX_REGIONS];
+static int region_count = 0;
+static unsigned region_seq = 0;
+static pthread_mutex_t region_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Returns the size of a block without the status bits
+ */
+static inline size_t block_size(block_tag *block){
+	return block->size_status & ~STATUS_BITS;
+}
+
+/*
+ * Returns the block which follows 'block' in memory
+ */
+static inline block_tag *next_block(block_tag *block){
+	return (block_tag*)((char*)block + block_size(block));
+}
+
+/*
+ * Returns the footer of a block of 'size' bytes starting at 'block'
+ */
+static inline block_tag *block_footer(block_tag *block, size_t size){
+	return (block_tag*)((char*)block + size - HEADER_SIZE);
+}
+
+/*
+ * Hardened builds, made with -DMEM_HARDEN
+ * Every busy block ends with a canary, a checksum of its address and size, which
+ * is written when the block is handed out and checked when it is freed, so a
+ * write past the end of a block or a damaged header is caught at the next free
+ * of the block instead of somewhere far away
+ * A block freed through Mem_Free first spends QUARANTINE_SIZE frees of its thread
+ * in a quarantine, still busy but with its canary inverted, so that freeing it
+ * again is told apart from a valid free in O(1), as is freeing a block that did
+ * leave the quarantine by its busy bit - blocks leaving it are coalesced right
+ * away, the thread caches and the quick lists are not used
+ * The canary does not depend on the process, so persistent and shared heaps keep working
+ * Slabs are not used as their slots carry no header
+ */
+#ifdef MEM_HARDEN
+#define CANARY_SIZE sizeof(size_t)
+#define QUARANTINE_SIZE 64
+
+/*
+ * Returns the canary of 'block', the status bits of the header are left out
+ * since its PREV_BUSY bit changes along with the previous block
+ */
+static inline size_t harden_canary(block_tag *block){
+	return ((uintptr_t)block ^ block_size(block)) * (size_t)0x9e3779b97f4a7c15ull;
+}
+
+static inline size_t *harden_tail(block_tag *block){
+	return (size_t*)((char*)block + block_size(block)) - 1;
+}
+
+/*
+ * Writes the canary of the busy block 'block'
+ */
+static inline void harden_seal(block_tag *block){
+	*harden_tail(block) = harden_canary(block);
+}
+
+/*
+ * Reports the damaged block 'block' and ends the program, the heap cannot be trusted any more
+ */
+static void harden_abort(block_tag *block, const char *what){
+	fprintf(stderr,"Error:mem.c: %s at block %p of %zu bytes\n", what, (void*)block, block_size(block));
+	abort();
+}
+
+/*
+ * Checks the canary of the busy block 'block' when it is freed
+ * Returns 1 if the block is intact and 0 if it waits in the quarantine, that is it was freed before
+ */
+static inline int harden_check(block_tag *block){
+	size_t canary = *harden_tail(block);
+
+	if(canary == harden_canary(block)) {
+		return 1;
+	}
+	if(canary == ~harden_canary(block)) {
+		fprintf(stderr,"Error:mem.c: Double free of %p\n", (void*)(block + 1));
+		return 0;
+	}
+	harden_abort(block, "Heap corruption - canary overwritten");
+	return 0;
+}
+#else
+#define CANARY_SIZE 0
+#define harden_seal(block)
+#endif
+
+/*
+ * Returns the chunk of 'arena' holding 'ptr', or NULL if no chunk of the arena holds it
+ * The epilogue counts as part of its chunk
+ */
+static mem_chunk *chunk_of(mem_arena *arena, void *ptr){
+	mem_chunk *chunk;
+
+	for(chunk = &arena->first_chunk; chunk != NULL; chunk = chunk->next) {
+		if((char*)ptr >= (char*)chunk->first_block && (char*)ptr < (char*)chunk->first_block + chunk->size) {
+			return chunk;
+		}
+	}
+	return NULL;
+}
+
+static inline size_t tree_size(tree_block *node){
+	return block_size(&node->header);
+}
+
+/*
+ * Top down splay of the tree at 'root' for 'size'
+ * Returns the new root, which is the node of 'size' if there is one and
+ * otherwise the next smaller or the next bigger node
+ * Adds the number of nodes looked at to 'visited'
  */
-void* Mem_Alloc(int size){
-	
-	//size must be positive
-	if(size <= 0) {
+static tree_block *tree_splay(tree_block *root, size_t size, size_t *visited){
+	tree_block split;
+	tree_block *left = &split;
+	tree_block *right = &split;
+	tree_block *node;
+
+	if(root == NULL) {
 		return NULL;
 	}
+	split.left = split.right = NULL;
+	for(;;) {
+		*visited += 1;
+		if(size < tree_size(root)) {
+			if(root->left == NULL) {
+				break;
+			}
+			//rotate right
+			if(size < tree_size(root->left)) {
+				node = root->left;
+				root->left = node->right;
+				node->right = root;
+				root = node;
+				if(root->left == NULL) {
+					break;
+				}
+			}
+			//link right
+			right->left = root;
+			right = root;
+			root = root->left;
+		}
+		else if(size > tree_size(root)) {
+			if(root->right == NULL) {
+				break;
+			}
+			//rotate left
+			if(size > tree_size(root->right)) {
+				node = root->right;
+				root->right = node->left;
+				node->left = root;
+				root = node;
+				if(root->right == NULL) {
+					break;
+				}
+			}
+			//link left
+			left->right = root;
+			left = root;
+			root = root->right;
+		}
+		else {
+			break;
+		}
+	}
+	//assemble
+	left->right = root->left;
+	right->left = root->right;
+	root->left = split.right;
+	root->right = split.left;
+	return root;
+}
+
+/*
+ * Adds a free block to the size tree, or to the chain of its size if that size is in the tree
+ */
+static void tree_insert(mem_arena *arena, tree_block *block){
+	size_t size = tree_size(block);
+	size_t visited = 0;
+	tree_block *root = tree_splay(arena->tree, size, &visited);
+
+	block->prev = NULL;
+	if(root != NULL && tree_size(root) == size) {
+		block->prev = root;
+		block->next = root->next;
+		if(block->next != NULL) {
+			block->next->prev = block;
+		}
+		root->next = block;
+		arena->tree = root;
+		return;
+	}
+
+	block->next = NULL;
+	if(root == NULL) {
+		block->left = block->right = NULL;
+	}
+	else if(size < tree_size(root)) {
+		block->left = root->left;
+		block->right = root;
+		root->left = NULL;
+	}
+	else {
+		block->right = root->right;
+		block->left = root;
+		root->right = NULL;
+	}
+	arena->tree = block;
+}
+
+/*
+ * Unlinks a free block from the size tree
+ * A block chained behind the node of its size is simply unlinked, otherwise
+ * the node is splayed to the root and replaced by the next block of its
+ * chain, or by the join of its subtrees
+ */
+static void tree_remove(mem_arena *arena, tree_block *block){
+	size_t visited = 0;
+	tree_block *root;
+
+	if(block->prev != NULL) {
+		block->prev->next = block->next;
+		if(block->next != NULL) {
+			block->next->prev = block->prev;
+		}
+		return;
+	}
+
+	root = tree_splay(arena->tree, tree_size(block), &visited);
+	if(block->next != NULL) {
+		block->next->prev = NULL;
+		block->next->left = root->left;
+		block->next->right = root->right;
+		arena->tree = block->next;
+	}
+	else if(root->left == NULL) {
+		arena->tree = root->right;
+	}
+	else {
+		//every node on the left is smaller, so splaying for this size brings the biggest one up
+		arena->tree = tree_splay(root->left, tree_size(block), &visited);
+		arena->tree->right = root->right;
+	}
+}
+
+/*
+ * Returns the smallest free block of at least 'size' bytes in the size tree
+ * With a nonzero 'slack' the tree is searched from the root without splaying
+ * and the first block found that is at most 'slack' bytes too big is taken
+ * Adds the number of nodes looked at to 'visited'
+ * Returns NULL if there is no such block
+ */
+static tree_block *tree_best_fit(mem_arena *arena, size_t size, size_t slack, size_t *visited){
+	tree_block *best = NULL;
+	tree_block *node;
 
-	//size must be a multiple of 4
-	if(size % 4 == 1) {
-		size += 3;
-	}
-	else if(size % 4 == 2) {
-		size += 2;
-	}
-	else if(size % 4 == 3) {
-		size += 1;
-	}
-	
-	//traverse the memory
-
-	//variables for size_status
-	int t_size;	
-	int is_busy = 1;
-	int prev_block_allocated = 2;
-	int header_size = 4;
-
-	//size of allocation is requested size plus a header
-	size = size + header_size;
-	
-	//block pointers to track best fitting block while traversing
-	block_tag *best_slot = NULL;
-	block_tag *current = first_block;
-	
-	//iterate through each block (like how Mem_Dump does)
-	while(current < (block_tag*)((char*)first_block + total_mem_size)){
-		
-		//update current's size_status
-		t_size = current->size_status;
-		
-		//if size is odd, the block is busy, so adjust down 1 for business and 2 for previous busy block to get raw size and iterate to next block
-		if(t_size & 1){
-			t_size -= 3;
-		}
-		//if size is even, the block is free, so adjust down 2 for previous busy block and check to see if this free block is best fit and update best_slot if it is
-		else{
-			t_size -= 2;
-			if(size <= current->size_status && (best_slot == NULL || current->size_status < best_slot->size_status)) {				
-				best_slot = current;
+	if(slack != 0) {
+		for(node = arena->tree; node != NULL; ) {
+			*visited += 1;
+			if(tree_size(node) < size) {
+				node = node->right;
+			}
+			else {
+				best = node;
+				if(tree_size(node) - size <= slack) {
+					break;
+				}
+				node = node->left;
 			}
 		}
-		//iterate to next block until the end of total_mem_size
-		current = (block_tag*)((char*)current + t_size);
+		return best;
 	}
-	//Return Null if there is no room for he requested allocation	
-	if(best_slot == NULL) {
-		//printf("\nNot enough space for allocation!\n");
-		return NULL;
+
+	//after the splay the root is the node of 'size' or a neighbour of it
+	node = arena->tree = tree_splay(arena->tree, size, visited);
+	if(node == NULL || tree_size(node) >= size) {
+		return node;
+	}
+	for(node = node->right; node != NULL && node->left != NULL; node = node->left) {
+		*visited += 1;
+	}
+	return node;
+}
+
+/*
+ * Returns the index of the bin holding free blocks of 'size' bytes
+ * 'size' is below SMALL_BIN_LIMIT
+ */
+static int bin_index(size_t size){
+	return size / MEM_ALIGN;
+}
+
+/*
+ * Adds a free block to the head of the bin for its size, or to the size tree
+ */
+static void bin_insert(mem_arena *arena, free_block *block){
+	size_t size = block_size(&block->header);
+
+	arena->stats.bytes_free += size;
+	if(size >= SMALL_BIN_LIMIT) {
+		tree_insert(arena, (tree_block*)block);
+		return;
+	}
+
+	int index = bin_index(size);
+	block->prev = NULL;
+	block->next = arena->bins[index];
+	if(block->next != NULL) {
+		block->next->prev = block;
+	}
+	arena->bins[index] = block;
+	arena->bin_map[index / 32] |= 1u << (index % 32);
+}
+
+/*
+ * Unlinks a free block from its bin or from the size tree
+ */
+static void bin_remove(mem_arena *arena, free_block *block){
+	size_t size = block_size(&block->header);
+
+	arena->stats.bytes_free -= size;
+	if(size >= SMALL_BIN_LIMIT) {
+		tree_remove(arena, (tree_block*)block);
+		return;
+	}
+
+	int index = bin_index(size);
+	if(block->prev != NULL) {
+		block->prev->next = block->next;
+	}
+	else {
+		arena->bins[index] = block->next;
+		if(arena->bins[index] == NULL) {
+			arena->bin_map[index / 32] &= ~(1u << (index % 32));
+		}
+	}
+	if(block->next != NULL) {
+		block->next->prev = block->prev;
+	}
+}
+
+/*
+ * Returns the index of the first non empty bin at or after 'index'
+ * Returns -1 if all those bins are empty
+ */
+static int next_bin(mem_arena *arena, int index){
+	int word = index / 32;
+	unsigned int bits;
+
+	if(index >= NUM_BINS) {
+		return -1;
+	}
+	bits = arena->bin_map[word] & (~0u << (index % 32));
+	while(bits == 0) {
+		if(++word == BIN_MAP_WORDS) {
+			return -1;
+		}
+		bits = arena->bin_map[word];
+	}
+	return word * 32 + __builtin_ctz(bits);
+}
+
+/*
+ * Returns the smallest free block of at least 'size' bytes in the heap
+ * Every bin holds blocks of a single size, so the head of the first non empty
+ * bin from the one for 'size' on is the best fit overall, and if there is
+ * none the size tree is searched
+ * With a nonzero 'slack' the first block found in the size tree that is at
+ * most 'slack' bytes too big is taken instead
+ * Returns NULL if there is no such block
+ */
+static free_block *find_best_fit(mem_arena *arena, size_t size, size_t slack, size_t *visited){
+
+	if(size < SMALL_BIN_LIMIT) {
+		int index = next_bin(arena, bin_index(size));
+		if(index != -1) {
+			*visited += 1;
+			return arena->bins[index];
+		}
+	}
+	return (free_block*)tree_best_fit(arena, size, slack, visited);
+}
+
+/*
+ * Returns the first free block of at least 'size' bytes in address order,
+ * starting at the rover of the arena and wrapping around at the end of the last chunk
+ * Returns NULL if there is no such block
+ */
+static free_block *find_next_fit(mem_arena *arena, size_t size, size_t *visited){
+	block_tag *start = arena->rover != NULL ? arena->rover : arena->first_chunk.first_block;
+	mem_chunk *chunk = chunk_of(arena, start);
+	block_tag *current = start;
+
+	do {
+		if(current == (block_tag*)((char*)chunk->first_block + chunk->size - HEADER_SIZE)) {
+			//epilogue reached, go on with the next chunk
+			chunk = chunk->next != NULL ? chunk->next : &arena->first_chunk;
+			current = chunk->first_block;
+			continue;
+		}
+		*visited += 1;
+		if(!(current->size_status & BUSY) && block_size(current) >= size) {
+			return (free_block*)current;
+		}
+		current = next_block(current);
+	} while(current != start);
+	return NULL;
+}
+
+/*
+ * Returns a free block of at least 'size' bytes chosen by the placement policy of the arena
+ * - MEM_BEST_FIT - the smallest block big enough
+ * - MEM_FIRST_FIT - the first block big enough met on the way through the bins and down the size tree
+ * - MEM_GOOD_FIT - like best fit, but the search of the size tree stops at the first block less than 1/8 bigger than 'size'
+ * - MEM_NEXT_FIT - the first block big enough in address order after the last block allocated
+ * The number of blocks looked at goes into the visits histogram of the arena
+ * Returns NULL if there is no such block
+ */
+static free_block *find_fit(mem_arena *arena, size_t size){
+	free_block *found;
+	size_t visited = 0;
+	int bucket = 0;
+
+	switch(arena->policy) {
+	case MEM_FIRST_FIT:
+		found = find_best_fit(arena, size, MAX_BLOCK_SIZE, &visited);
+		break;
+	case MEM_GOOD_FIT:
+		found = find_best_fit(arena, size, size / 8, &visited);
+		break;
+	case MEM_NEXT_FIT:
+		found = find_next_fit(arena, size, &visited);
+		break;
+	default:
+		found = find_best_fit(arena, size, 0, &visited);
+		break;
+	}
+
+	//bucket i > 0 holds searches which looked at 2^(i-1) to 2^i - 1 blocks
+	if(visited != 0) {
+		bucket = SIZE_BITS - __builtin_clzl(visited);
+		if(bucket >= MEM_STATS_VISIT_BUCKETS) {
+			bucket = MEM_STATS_VISIT_BUCKETS - 1;
+		}
+	}
+	arena->stats.visits[bucket]++;
+	return found;
+}
+
+/*
+ * Keeps the rover on a block header when the blocks within the 'size' bytes
+ * at 'block' become one block
+ */
+static inline void rover_merge(mem_arena *arena, block_tag *block, size_t size){
+	if(arena->rover > block && (char*)arena->rover < (char*)block + size) {
+		arena->rover = block;
+	}
+}
+
+/*
+ * Returns the size of the biggest free block of the arena, 0 if there is none
+ * That is the rightmost node of the size tree, or the size of the last non empty bin
+ */
+static size_t largest_free_block(mem_arena *arena){
+	tree_block *node = arena->tree;
+	int word;
+
+	if(node != NULL) {
+		while(node->right != NULL) {
+			node = node->right;
+		}
+		return tree_size(node);
+	}
+	for(word = BIN_MAP_WORDS - 1; word >= 0; word--) {
+		if(arena->bin_map[word] != 0) {
+			return (word * 32 + 31 - __builtin_clz(arena->bin_map[word])) * MEM_ALIGN;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Maps 'alloc_size' bytes of zeroed memory
+ * Returns the address of the mapping on success and NULL on failure
+ */
+static void *map_region(size_t alloc_size){
+  int fd;
+  void* space_ptr;
+
+  // Using mmap to allocate memory
+  fd = open("/dev/zero", O_RDWR);
+  if(-1 == fd){
+    fprintf(stderr,"Error:mem.c: Cannot open /dev/zero\n");
+    return NULL;
+  }
+  space_ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == space_ptr){
+    fprintf(stderr,"Error:mem.c: mmap cannot allocate space\n");
+    return NULL;
+  }
+  return space_ptr;
+}
+
+/*
+ * Returns 'size' rounded up to a multiple of the page size
+ */
+static size_t round_to_pages(size_t size){
+  size_t pagesize;
+  size_t padsize;
+
+  // Get the pagesize
+  pagesize = getpagesize();
+
+  // Calculate padsize as the padding required to round up size to a multiple of pagesize
+  padsize = size % pagesize;
+  padsize = (pagesize - padsize) % pagesize;
+
+  return size + padsize;
+}
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+//transparent hugepages are 2 MB, a range must be aligned to that to get them
+#define THP_SIZE ((size_t)2 << 20)
+
+#define MEM_INIT_FLAGS (MEM_INIT_GROWABLE | MEM_INIT_ANONYMOUS | MEM_INIT_HUGETLB_2MB | MEM_INIT_HUGETLB_1GB | \
+                        MEM_INIT_THP | MEM_INIT_POPULATE | MEM_INIT_LOCK | MEM_INIT_NUMA)
+
+/*
+ * Returns the size of the pages a heap mapped with the MEM_INIT_* options in 'flags' is made of,
+ * chunk mappings are multiples of it
+ */
+static size_t heap_page_size(int flags){
+  if(flags & MEM_INIT_HUGETLB_1GB){
+    return (size_t)1 << 30;
+  }
+  if(flags & (MEM_INIT_HUGETLB_2MB | MEM_INIT_THP)){
+    return THP_SIZE;
+  }
+  return getpagesize();
+}
+
+//NUMA nodes the heap can spread over, nodes with higher numbers share the arena of the first node
+#define MEM_MAX_NODES 16
+#define MEM_MPOL_PREFERRED 1
+
+/*
+ * Asks the kernel to place the pages of [ptr, ptr + size) on 'node'
+ * Placement is only an optimization - without mbind, as in some sandboxes,
+ * the pages just go where they are first touched
+ */
+static void bind_to_node(void *ptr, size_t size, int node){
+  unsigned long mask[MEM_MAX_NODES / (8 * sizeof(unsigned long)) + 1] = {0};
+
+  mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+  syscall(SYS_mbind, ptr, size, MEM_MPOL_PREFERRED, mask, MEM_MAX_NODES + 1, 0);
+}
+
+/*
+ * Maps 'alloc_size' bytes of zeroed memory for a chunk with the MEM_INIT_* options
+ * in 'flags', placed on 'node' unless it is -1
+ * 'alloc_size' must be a multiple of heap_page_size(flags)
+ * Without any option besides MEM_INIT_GROWABLE and no node this is map_region,
+ * otherwise anonymous memory is mapped
+ * Returns the address of the mapping on success and NULL on failure
+ */
+static void *map_heap(size_t alloc_size, int flags, int node){
+  int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  size_t extra = 0;
+  char* space_ptr;
+
+  if(0 == (flags & ~(MEM_INIT_GROWABLE | MEM_INIT_NUMA)) && node < 0){
+    return map_region(alloc_size);
+  }
+
+  if(flags & MEM_INIT_HUGETLB_2MB){
+    mmap_flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+  }
+  if(flags & MEM_INIT_HUGETLB_1GB){
+    mmap_flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+  }
+  // Transparent hugepages need an aligned range, so map more than needed and cut it down
+  if(flags & MEM_INIT_THP){
+    extra = THP_SIZE;
+  }
+  // The kernel can only fault the pages in right away if there is nothing to do before
+  if((flags & MEM_INIT_POPULATE) && !(flags & MEM_INIT_THP) && node < 0){
+    mmap_flags |= MAP_POPULATE;
+  }
+
+  space_ptr = mmap(NULL, alloc_size + extra, PROT_READ | PROT_WRITE, mmap_flags, -1, 0);
+  if (MAP_FAILED == space_ptr){
+    fprintf(stderr,"Error:mem.c: mmap cannot allocate space\n");
+    return NULL;
+  }
+
+  if(flags & MEM_INIT_THP){
+    char* aligned = (char*)ALIGN_UP((uintptr_t)space_ptr, THP_SIZE);
+
+    if(aligned != space_ptr){
+      munmap(space_ptr, aligned - space_ptr);
+    }
+    if(space_ptr + extra != aligned){
+      munmap(aligned + alloc_size, space_ptr + extra - aligned);
+    }
+    space_ptr = aligned;
+
+    // Only a hint, without transparent hugepages the heap keeps small pages
+    madvise(space_ptr, alloc_size, MADV_HUGEPAGE);
+  }
+  if(node >= 0){
+    bind_to_node(space_ptr, alloc_size, node);
+  }
+
+  // Fault the pages in after the advice and the placement, so the faults follow them
+  if((flags & MEM_INIT_POPULATE) && !(mmap_flags & MAP_POPULATE)){
+    for(size_t offset = 0; offset < alloc_size; offset += getpagesize()){
+      ((volatile char*)space_ptr)[offset] = 0;
+    }
+  }
+
+  if((flags & MEM_INIT_LOCK) && 0 != mlock(space_ptr, alloc_size)){
+    fprintf(stderr,"Error:mem.c: mlock cannot lock the heap into memory\n");
+    munmap(space_ptr, alloc_size);
+    return NULL;
+  }
+  return space_ptr;
+}
+
+/*
+ * Returns the page holding first_block, the first page covered by the slab map of 'chunk'
+ */
+static inline uintptr_t slab_map_base(mem_chunk *chunk){
+  return (uintptr_t)chunk->first_block & ~((uintptr_t)getpagesize() - 1);
+}
+
+/*
+ * Returns the size of the slab map of 'chunk' in bytes
+ */
+static size_t slab_map_size(mem_chunk *chunk){
+  size_t pages = ((uintptr_t)chunk->first_block + chunk->size - slab_map_base(chunk)) / getpagesize() + 1;
+
+  return (pages + 7) / 8;
+}
+
+/*
+ * Copies entry 'from' of the address range table over entry 'to'
+ * The caller must hold region_lock and have made region_seq odd
+ */
+static void region_move(int to, int from){
+  __atomic_store_n(&regions[to].start, regions[from].start, __ATOMIC_RELAXED);
+  __atomic_store_n(&regions[to].end, regions[from].end, __ATOMIC_RELAXED);
+  __atomic_store_n(&regions[to].chunk, regions[from].chunk, __ATOMIC_RELAXED);
+  __atomic_store_n(&regions[to].arena, regions[from].arena, __ATOMIC_RELAXED);
+}
+
+static void region_write_begin(void){
+  __atomic_store_n(&region_seq, region_seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void region_write_end(void){
+  __atomic_store_n(&region_seq, region_seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Enters a chunk into the address range table
+ * Returns 0 on success and -1 if the table is full
+ */
+static int region_add(mem_arena *arena, mem_chunk *chunk){
+  char *start = (char*)chunk->first_block;
+  int i;
+
+  pthread_mutex_lock(&region_lock);
+  if(MEM_MAX_REGIONS == region_count){
+    pthread_mutex_unlock(&region_lock);
+    fprintf(stderr,"Error:mem.c: All %d entries of the address range table are taken by arenas and chunks\n", MEM_MAX_REGIONS);
+    return -1;
+  }
+  region_write_begin();
+  for(i = region_count; i > 0 && regions[i - 1].start > start; i--){
+    region_move(i, i - 1);
+  }
+  __atomic_store_n(&regions[i].start, start, __ATOMIC_RELAXED);
+  __atomic_store_n(&regions[i].end, start + chunk->size, __ATOMIC_RELAXED);
+  __atomic_store_n(&regions[i].chunk, chunk, __ATOMIC_RELAXED);
+  __atomic_store_n(&regions[i].arena, arena, __ATOMIC_RELAXED);
+  __atomic_store_n(&region_count, region_count + 1, __ATOMIC_RELAXED);
+  region_write_end();
+  pthread_mutex_unlock(&region_lock);
+  return 0;
+}
+
+/*
+ * Takes the entry of a chunk out of the address range table
+ */
+static void region_remove(mem_chunk *chunk){
+  int i;
+
+  pthread_mutex_lock(&region_lock);
+  for(i = 0; i < region_count; i++){
+    if(chunk == regions[i].chunk){
+      break;
+    }
+  }
+  if(i < region_count){
+    region_write_begin();
+    for(; i < region_count - 1; i++){
+      region_move(i, i + 1);
+    }
+    __atomic_store_n(&region_count, region_count - 1, __ATOMIC_RELAXED);
+    region_write_end();
+  }
+  pthread_mutex_unlock(&region_lock);
+}
+
+/*
+ * Sets up 'chunk' as one big free block within the 'size' bytes at 'space_ptr'
+ * followed by the epilogue, and enters it into the address range table
+ * The first block starts where its payload is MEM_ALIGN aligned
+ * Returns 0 on success and -1 if the table is full
+ */
+static int chunk_init(mem_arena *arena, mem_chunk *chunk, void *space_ptr, size_t size){
+  size_t padding = ALIGN_UP((uintptr_t)space_ptr + HEADER_SIZE, MEM_ALIGN) - HEADER_SIZE - (uintptr_t)space_ptr;
+  size_t free_size = (size - padding - HEADER_SIZE) & ~(MEM_ALIGN - 1);
+
+  chunk->first_block = (block_tag*)((char*)space_ptr + padding);
+  chunk->size = free_size + HEADER_SIZE;
+  chunk->slab_map = NULL;
+  chunk->untouched = (char*)chunk->first_block;
+  if(-1 == region_add(arena, chunk)){
+    return -1;
+  }
+
+  // Setting up the header
+  chunk->first_block->size_status = free_size;
+  // Marking the previous block as busy
+  chunk->first_block->size_status += 2;
+
+  // Setting up the footer
+  block_tag *footer = (block_tag*)((char*)chunk->first_block + free_size - HEADER_SIZE);
+  footer->size_status = free_size;
+
+  // Setting up the epilogue, a busy block of size 0 following the free block
+  (footer + 1)->size_status = BUSY;
+
+  // The free block goes into the bin for its size
+  bin_insert(arena, (free_block*)chunk->first_block);
+
+  arena->total_mem_size += chunk->size;
+  return 0;
+}
+
+/*
+ * Maps an additional chunk that can hold a block of 'size' bytes and links it
+ * at the end of the chunk list of 'arena'
+ * The chunk is at least as big as the arena already is, so the number of
+ * chunks stays logarithmic in the size of the heap
+ * The caller must hold the lock of the arena
+ * Returns 0 on success and -1 on failure
+ */
+static int arena_grow(mem_arena *arena, size_t size){
+  size_t alloc_size;
+  void* space_ptr;
+  mem_chunk *chunk;
+
+  // Room for the chunk structure, the alignment padding, the block and the epilogue
+  if(size > MAX_BLOCK_SIZE - arena->total_mem_size){
+    return -1;
+  }
+  alloc_size = sizeof(mem_chunk) + MEM_ALIGN + size + HEADER_SIZE;
+  if(alloc_size < arena->total_mem_size){
+    alloc_size = arena->total_mem_size;
+  }
+  alloc_size = ALIGN_UP(alloc_size, heap_page_size(arena->map_flags));
+
+  space_ptr = map_heap(alloc_size, arena->map_flags, arena->node);
+  if(NULL == space_ptr){
+    return -1;
+  }
+
+  chunk = (mem_chunk*) space_ptr;
+  if(-1 == chunk_init(arena, chunk, chunk + 1, alloc_size - sizeof(mem_chunk))){
+    munmap(space_ptr, alloc_size);
+    return -1;
+  }
+  chunk->next = NULL;
+  chunk->prev = arena->last_chunk;
+  arena->last_chunk->next = chunk;
+  arena->last_chunk = chunk;
+  return 0;
+}
+
+/*
+ * Unmaps the chunks at the end of the chunk list of 'arena' which are completely free
+ * The region the arena was created with is always kept
+ * The caller must hold the lock of the arena
+ */
+static void arena_shrink(mem_arena *arena){
+  mem_chunk *chunk = arena->last_chunk;
+
+  while(chunk != &arena->first_chunk){
+    block_tag *block = chunk->first_block;
+
+    // An empty chunk holds one free block followed by the epilogue
+    if((block->size_status & BUSY) || block_size(block) != chunk->size - HEADER_SIZE){
+      break;
+    }
+    bin_remove(arena, (free_block*)block);
+    region_remove(chunk);
+    if(chunk == chunk_of(arena, arena->rover)){
+      arena->rover = NULL;
+    }
+    arena->total_mem_size -= chunk->size;
+    arena->last_chunk = chunk->prev;
+    arena->last_chunk->next = NULL;
+    if(NULL != chunk->slab_map){
+      munmap(chunk->slab_map, slab_map_size(chunk));
+    }
+    munmap(chunk, ALIGN_UP((uintptr_t)chunk->first_block + chunk->size - (uintptr_t)chunk, heap_page_size(arena->map_flags)));
+    chunk = arena->last_chunk;
+  }
+}
+
+/*
+ * Returns the number of bytes of the pages from 'start' to 'end' which are resident,
+ * all of them if mincore fails
+ */
+static size_t resident_bytes(uintptr_t start, uintptr_t end){
+  uintptr_t pagesize = getpagesize();
+  unsigned char pages[256];
+  size_t bytes = 0;
+
+  while(start < end){
+    size_t count = (end - start) / pagesize;
+    if(count > sizeof(pages)){
+      count = sizeof(pages);
+    }
+    if(0 != mincore((void*)start, count * pagesize, pages)){
+      return bytes + (end - start);
+    }
+    for(size_t i = 0; i < count; i++){
+      bytes += (pages[i] & 1) * pagesize;
+    }
+    start += count * pagesize;
+  }
+  return bytes;
+}
+
+/*
+ * Gives the pages inside the free blocks of 'arena' back to the system with
+ * madvise, the pages holding the header, the links and the footer of a block
+ * stay, so only blocks spanning more than that are trimmed
+ * The memory reads as zeroes once it is touched again, which free blocks do not mind,
+ * so trimming the last block of a chunk can move the untouched mark of the chunk back
+ * Only the pages which were resident are counted, so pages trimmed before count once
+ * Arenas mapped shared keep their pages in the file or the shared memory object,
+ * madvise would not give anything back, so they are not trimmed and count nothing
+ * The caller must hold the lock of the arena
+ * Returns the number of bytes given back
+ */
+static size_t arena_trim(mem_arena *arena){
+  uintptr_t pagesize = getpagesize();
+  size_t released = 0;
+
+  if(arena->map_flags & MEM_MAP_SHARED){
+    arena->trim_pending = 0;
+    return 0;
+  }
+  for(mem_chunk *chunk = &arena->first_chunk; chunk != NULL; chunk = chunk->next){
+    block_tag *epilogue = (block_tag*)((char*)chunk->first_block + chunk->size - HEADER_SIZE);
+
+    for(block_tag *current = chunk->first_block; current != epilogue; current = next_block(current)){
+      size_t size = block_size(current);
+      uintptr_t start = ALIGN_UP((uintptr_t)current + sizeof(tree_block), pagesize);
+      uintptr_t end = ((uintptr_t)current + size - HEADER_SIZE) & ~(pagesize - 1);
+
+      if(!(current->size_status & BUSY) && start < end){
+        size_t resident = resident_bytes(start, end);
+        if(0 != madvise((void*)start, end - start, MADV_DONTNEED)){
+          continue;
+        }
+        released += resident;
+        //the header and links a block left at the mark have to be among the pages cleared
+        if(next_block(current) == epilogue && (uintptr_t)chunk->untouched + sizeof(tree_block) <= end
+           && (uintptr_t)chunk->untouched > start){
+          chunk->untouched = (char*)start;
+        }
+      }
+    }
+  }
+  arena->trim_pending = 0;
+  arena->stats.trim_count++;
+  arena->stats.bytes_trimmed += released;
+  return released;
+}
+
+/*
+ * Sets up 'arena' with one chunk spanning the region of 'size' bytes at 'space_ptr'
+ * Returns 0 on success and -1 if the address range table is full
+ */
+static int arena_init(mem_arena *arena, void *space_ptr, size_t size, int growable){
+
+  arena->total_mem_size = 0;
+  arena->growable = growable;
+  arena->rover = NULL;
+  arena->trim_pending = 0;
+  arena->trim_threshold = 0;
+  arena->node = -1;
+  arena->remote_frees = NULL;
+  memset(arena->quick, 0, sizeof(arena->quick));
+  arena->quick_bytes = 0;
+  arena->defer_threshold = 0;
+  arena->first_chunk.next = NULL;
+  arena->first_chunk.prev = NULL;
+  arena->last_chunk = &arena->first_chunk;
+  return chunk_init(arena, &arena->first_chunk, space_ptr, size);
+}
+
+/*
+ * Start of the part of the block last carved by the thread which had never been handed
+ * out before, set by carve_block only if there is such a part, see Mem_Calloc
+ */
+static __thread char *carved_untouched;
+
+/*
+ * Moves the untouched mark of the chunk holding the busy block 'block' past it
+ * Returns the first byte of the payload which was untouched so far, NULL if there is none
+ * The caller must hold the lock of the arena
+ */
+static inline char *chunk_touch(mem_arena *arena, block_tag *block){
+	char *end = (char*)next_block(block);
+	mem_chunk *chunk = &arena->first_chunk;
+	char *untouched;
+
+	//nearly always the block is below the mark of the first chunk
+	if(end <= chunk->untouched && block >= chunk->first_block) {
+		return NULL;
+	}
+	chunk = chunk_of(arena, block);
+	if(end <= chunk->untouched) {
+		return NULL;
+	}
+	untouched = chunk->untouched > (char*)(block + 1) ? chunk->untouched : (char*)(block + 1);
+	chunk->untouched = end;
+	return untouched;
+}
+
+/*
+ * Marks the free block 'newBlock', which is in no bin, as a busy block of 'size' bytes
+ * The rest of the block is split off as a free block if it is big enough to be a block on its own
+ */
+static void carve_block(mem_arena *arena, block_tag *newBlock, size_t size){
+	size_t preSplitSize = block_size(newBlock);
+
+	//split off the extra free memory if it is big enough to be a block on its own
+	if(preSplitSize - size >= MIN_BLOCK_SIZE) {
+
+		newBlock->size_status = size + BUSY + (newBlock->size_status & PREV_BUSY);
+
+		//this block points the the extra free memory that is split from the allocation
+		block_tag *splitBlock = next_block(newBlock);
+		splitBlock->size_status = (preSplitSize - size) + PREV_BUSY;
+
+		//setting up the footer for the split block
+		block_footer(splitBlock, preSplitSize - size)->size_status = preSplitSize - size;
+		bin_insert(arena, (free_block*)splitBlock);
+	}
+	else {
+		newBlock->size_status += BUSY;
+
+		//the next block's previous block is now busy, the epilogue ends every chunk
+		next_block(newBlock)->size_status += PREV_BUSY;
+	}
+	harden_seal(newBlock);
+
+	char *untouched = chunk_touch(arena, newBlock);
+	if(untouched != NULL) {
+		carved_untouched = untouched;
+	}
+}
+
+/*
+ * Marks a busy block as free, coalesces it with its free neighbours and puts
+ * the coalesced block into the bin for its size
+ * The header, the next header and - only if the previous block is free -
+ * the previous footer are each read exactly once, and those reads decide
+ * which of the four coalesce cases applies
+ * Headers which end up inside the coalesced block are left marked free, so
+ * check_free refuses to free them a second time
+ * Once trim_threshold bytes have been freed since the last trim, the arena is trimmed
+ * The caller must hold the lock of the arena
+ */
+static void heap_free(mem_arena *arena, block_tag *coalescedBlock){
+	size_t status = coalescedBlock->size_status;
+	size_t size = status & ~STATUS_BITS;
+	size_t freed = size;
+	block_tag *next = (block_tag*)((char*)coalescedBlock + size);
+	size_t nextStatus = next->size_status;
+
+	//Fast path - next block busy (the epilogue always is) and previous block busy
+	if((nextStatus & BUSY) && (status & PREV_BUSY)) {
+		coalescedBlock->size_status = size + PREV_BUSY;
+		block_footer(coalescedBlock, size)->size_status = size;
+		next->size_status = nextStatus & ~PREV_BUSY;
+	}
+	else {
+		//If the next block is free, take it out of its bin and absorb it
+		//its own next block already knows that its previous block is free
+		if(!(nextStatus & BUSY)) {
+			bin_remove(arena, (free_block*)next);
+			size += nextStatus & ~STATUS_BITS;
+			next->size_status = nextStatus & ~PREV_BUSY;
+		}
+		else {
+			next->size_status = nextStatus & ~PREV_BUSY;
+		}
+
+		//If the previous block is free, its footer tells where its header is
+		if(!(status & PREV_BUSY)) {
+			size_t prevSize = (coalescedBlock - 1)->size_status;
+			coalescedBlock->size_status = status & ~BUSY;
+			coalescedBlock = (block_tag*)((char*)coalescedBlock - prevSize);
+			bin_remove(arena, (free_block*)coalescedBlock);
+			size += prevSize;
+		}
+
+		//the previous block of a free block is always busy since free neighbours are coalesced
+		coalescedBlock->size_status = size + PREV_BUSY;
+		block_footer(coalescedBlock, size)->size_status = size;
+	}
+	rover_merge(arena, coalescedBlock, size);
+	bin_insert(arena, (free_block*)coalescedBlock);
+
+	//give empty chunks at the end of a growable arena back to the system
+	if(coalescedBlock == arena->last_chunk->first_block) {
+		arena_shrink(arena);
+	}
+
+	//and the pages inside the free blocks once enough has been freed since the last trim
+	if(arena->trim_threshold != 0) {
+		arena->trim_pending += freed;
+		if(arena->trim_pending >= arena->trim_threshold) {
+			arena_trim(arena);
+		}
+	}
+}
+
+/*
+ * Deferred coalescing, turned on for an arena by Mem_ArenaSetDeferThreshold
+ * Freed blocks of at most QUICK_MAX_SIZE bytes are not coalesced but kept on a
+ * quick list for their exact size, still marked busy and linked through their
+ * payload, and handed out again as they are by the next allocation of that size
+ * Once the blocks on the quick lists add up to defer_threshold bytes, or an
+ * allocation finds no free block, the arena is swept - every block on the quick
+ * lists is freed and coalesces like any other
+ */
+
+static inline block_tag *quick_pop(mem_arena *arena, int index){
+	block_tag *block = arena->quick[index];
+
+	arena->quick[index] = *(block_tag**)(block + 1);
+	arena->quick_bytes -= index * MEM_ALIGN;
+	return block;
+}
+
+/*
+ * Frees every block on the quick lists of 'arena'
+ * The caller must hold the lock of the arena
+ * Returns the number of bytes freed
+ */
+static size_t arena_sweep(mem_arena *arena){
+	size_t swept = arena->quick_bytes;
+	int index;
+
+	for(index = 0; index < QUICK_LISTS; index++) {
+		while(arena->quick[index] != NULL) {
+			heap_free(arena, quick_pop(arena, index));
+		}
+	}
+	if(swept != 0) {
+		arena->stats.sweep_count++;
+	}
+	return swept;
+}
+
+/*
+ * Frees the busy block 'block', or keeps it on its quick list if coalescing is deferred
+ * The caller must hold the lock of the arena
+ */
+static void heap_release(mem_arena *arena, block_tag *block){
+	size_t size = block_size(block);
+
+	if(arena->defer_threshold == 0 || size > QUICK_MAX_SIZE) {
+		heap_free(arena, block);
+		return;
+	}
+	*(block_tag**)(block + 1) = arena->quick[size / MEM_ALIGN];
+	arena->quick[size / MEM_ALIGN] = block;
+	arena->quick_bytes += size;
+	if(arena->quick_bytes >= arena->defer_threshold) {
+		arena_sweep(arena);
+	}
+}
+
+/*
+ * Remote frees
+ * A free that would have to wait for the lock of an arena pushes the block onto
+ * the remote_frees list of the arena with a single compare and swap instead
+ * Whoever takes the lock next takes the whole list over with one exchange and
+ * frees the blocks as usual, so they coalesce like any other free block
+ * Taking the whole list at once keeps the list safe from ABA without any tags
+ */
+
+/*
+ * Pushes the busy block 'block' onto the remote frees of 'arena', does not need the lock
+ */
+static void free_remote(mem_arena *arena, block_tag *block){
+	void **ptr = (void**)(block + 1);
+	void *head = __atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED);
+
+	do {
+		*ptr = head;
+	} while(!__atomic_compare_exchange_n(&arena->remote_frees, &head, ptr, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	__atomic_fetch_add(&arena->stats.remote_frees, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Frees every block pushed onto the remote frees of 'arena'
+ * The caller must hold the lock of the arena
+ */
+static void arena_drain(mem_arena *arena){
+	void *ptr = __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+
+	while(ptr != NULL) {
+		void *next = *(void**)ptr;
+		heap_release(arena, (block_tag*)ptr - 1);
+		arena->stats.free_count++;
+		ptr = next;
+	}
+}
+
+/*
+ * Takes the lock of 'arena' and frees what was pushed onto its remote frees meanwhile
+ * The main arena of a persistent heap is marked as changed since the last sync
+ */
+static inline void arena_lock(mem_arena *arena){
+	pthread_mutex_lock(&arena->lock);
+	//the synced state of a persistent heap is out of date from here on
+	if(arena == &main_arena && persist.super != NULL && persist.super->clean) {
+		persist.super->clean = 0;
+	}
+	if(__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) != NULL) {
+		arena_drain(arena);
+	}
+}
+
+/*
+ * Frees the busy block 'block' of 'arena', or leaves it to the holder of the lock if it is taken
+ */
+static void arena_free(mem_arena *arena, block_tag *block){
+	if(pthread_mutex_trylock(&arena->lock) != 0) {
+		free_remote(arena, block);
+		return;
+	}
+	if(__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) != NULL) {
+		arena_drain(arena);
+	}
+	heap_release(arena, block);
+	arena->stats.free_count++;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+ * Takes a block of 'size' bytes (header included, already rounded) out of an arena
+ * A block of that size on a quick list comes first, the quick lists are swept
+ * before the arena grows or gives up
+ * The caller must hold the lock of the arena
+ * Returns the header of the allocated block on success
+ * Returns NULL if there is no free block big enough
+ */
+static block_tag *heap_alloc(mem_arena *arena, size_t size){
+
+	//a block of exactly this size waiting on a quick list is taken as it is
+	if(size <= QUICK_MAX_SIZE && arena->quick[size / MEM_ALIGN] != NULL) {
+		return quick_pop(arena, size / MEM_ALIGN);
+	}
+
+	//look up a fitting free block according to the placement policy
+	free_block *best_slot = find_fit(arena, size);
+
+	//the blocks on the quick lists may add up to one that fits
+	if(best_slot == NULL && arena->quick_bytes != 0) {
+		arena_sweep(arena);
+		best_slot = find_fit(arena, size);
+	}
+
+	//a growable arena adds a chunk big enough for the block
+	if(best_slot == NULL && arena->growable && arena_grow(arena, size) == 0) {
+		best_slot = find_fit(arena, size);
+	}
+
+	//Return Null if there is no room for he requested allocation	
+	if(best_slot == NULL) {
+		return NULL;
+	}
+	bin_remove(arena, best_slot);
+
+	carve_block(arena, &best_slot->header, size);
+	arena->rover = next_block(&best_slot->header);
+	return &best_slot->header;
+}
+
+/*
+ * Takes a block of 'size' bytes (header included, already rounded) whose
+ * payload is aligned to 'alignment' out of an arena
+ * 'alignment' is a power of two bigger than MEM_ALIGN
+ * The padding in front of the aligned payload is split off as a free block
+ * The caller must hold the lock of the arena
+ * Returns the header of the allocated block on success
+ * Returns NULL if there is no free block big enough
+ */
+static block_tag *heap_alloc_aligned(mem_arena *arena, size_t size, size_t alignment){
+
+	//big enough for the block whatever the padding, which is either 0 or a block on its own
+	if(size > MAX_BLOCK_SIZE - alignment - MIN_BLOCK_SIZE) {
+		return NULL;
+	}
+	size_t needed = size + alignment + MIN_BLOCK_SIZE;
+
+	free_block *best_slot = find_fit(arena, needed);
+	if(best_slot == NULL && arena->quick_bytes != 0) {
+		arena_sweep(arena);
+		best_slot = find_fit(arena, needed);
+	}
+	if(best_slot == NULL && arena->growable && arena_grow(arena, needed) == 0) {
+		best_slot = find_fit(arena, needed);
+	}
+	if(best_slot == NULL) {
+		return NULL;
+	}
+	bin_remove(arena, best_slot);
+
+	block_tag *block = &best_slot->header;
+	size_t blockSize = block_size(block);
+	uintptr_t payload = ALIGN_UP((uintptr_t)block + HEADER_SIZE, alignment);
+	size_t padding = payload - HEADER_SIZE - (uintptr_t)block;
+
+	//padding too small to be a free block, move on to the next aligned address
+	if(padding != 0 && padding < MIN_BLOCK_SIZE) {
+		padding += alignment;
+	}
+
+	if(padding != 0) {
+		//the padding becomes a free block, the previous block of a free block is always busy
+		block->size_status = padding + PREV_BUSY;
+		block_footer(block, padding)->size_status = padding;
+		bin_insert(arena, (free_block*)block);
+
+		//the aligned block follows the free padding block
+		block = (block_tag*)((char*)block + padding);
+		block->size_status = blockSize - padding;
+	}
+
+	carve_block(arena, block, size);
+	arena->rover = next_block(block);
+	return block;
+}
+
+/*
+ * Resizes a busy block in place to 'size' bytes (header included, already rounded)
+ * A block that has to grow absorbs the next block if that one is free and big enough
+ * Whatever the block has beyond 'size' is split off if it is big enough to be
+ * a block on its own, and freed so that it coalesces with a free next block
+ * The caller must hold the lock of the arena
+ * Returns 0 on success and -1 if the block cannot grow in place
+ */
+static int heap_resize(mem_arena *arena, block_tag *block, size_t size){
+	size_t status = block->size_status;
+	size_t blockSize = status & ~STATUS_BITS;
+	block_tag *next = next_block(block);
+
+	if(size > blockSize) {
+		//the epilogue is busy, so this never reaches past the chunk
+		if((next->size_status & BUSY) || blockSize + block_size(next) < size) {
+			return -1;
+		}
+		bin_remove(arena, (free_block*)next);
+		blockSize += block_size(next);
+		rover_merge(arena, block, blockSize);
+		block->size_status = blockSize + (status & STATUS_BITS);
+		next_block(block)->size_status += PREV_BUSY;
+	}
+
+	if(blockSize - size >= MIN_BLOCK_SIZE) {
+		block->size_status = size + (status & STATUS_BITS);
+
+		//the tail becomes a busy block of its own and is freed like any other
+		block_tag *tail = next_block(block);
+		tail->size_status = (blockSize - size) + BUSY + PREV_BUSY;
+		heap_free(arena, tail);
+	}
+	harden_seal(block);
+	chunk_touch(arena, block);
+	return 0;
+}
+
+/*
+ * Slabs of small objects
+ * A slab is a busy block of the main arena of exactly one page whose payload
+ * starts on a page boundary, carved into equal slots of one slab class
+ * The header of the block following a slab takes the last bytes of the page,
+ * so slabs carved one after the other leave no padding in between
+ * Slots carry no header, free slots are kept in an intrusive list of the slab,
+ * and slots never handed out yet are taken from the end of the used part in order
+ * The bit for the page in the slab map of its chunk tells a slot apart from a
+ * general block by address alone
+ * A slab is given back to the heap as soon as its last slot is freed
+ * Slabs are only touched with the lock of the main arena held
+ */
+struct mem_slab{
+
+  /* Slabs of the same class with at least one free slot */
+  struct mem_slab *next;
+  struct mem_slab *prev;
+
+  /* The chunk holding the slab */
+  mem_chunk *chunk;
+
+  /* Freed slots, linked through their first bytes */
+  void *free_slots;
+
+  /* Slots from here on to the end of the payload were never handed out */
+  char *unused;
+
+  /* Size of a slot, class 'index' holds slots of index * MEM_ALIGN bytes */
+  size_t slot_size;
+  int index;
+
+  /* Number of slots handed out */
+  int used;
+
+};
+
+//the slots follow the slab header, aligned like every payload
+#define SLAB_HEADER_SIZE ALIGN_UP(sizeof(mem_slab), MEM_ALIGN)
+
+/*
+ * Returns the slab holding 'ptr', or NULL if 'ptr' is not inside a slab of 'chunk'
+ * Does not need the lock, a slab is only marked in the map while its slots can be handed out
+ */
+static inline mem_slab *slab_lookup(mem_chunk *chunk, void *ptr){
+	unsigned char *map = __atomic_load_n(&chunk->slab_map, __ATOMIC_ACQUIRE);
+	size_t page;
+
+	if(map == NULL) {
+		return NULL;
+	}
+	page = ((uintptr_t)ptr - slab_map_base(chunk)) / getpagesize();
+	if(!(__atomic_load_n(&map[page / 8], __ATOMIC_RELAXED) & (1 << (page % 8)))) {
+		return NULL;
+	}
+	return (mem_slab*)((uintptr_t)ptr & ~((uintptr_t)getpagesize() - 1));
+}
+
+/*
+ * Sets or clears the bit of the page holding 'slab' in the slab map of its chunk
+ */
+static void slab_mark(mem_slab *slab, int set){
+	mem_chunk *chunk = slab->chunk;
+	size_t page = ((uintptr_t)slab - slab_map_base(chunk)) / getpagesize();
+
+	if(set) {
+		__atomic_fetch_or(&chunk->slab_map[page / 8], 1 << (page % 8), __ATOMIC_RELAXED);
+	}
+	else {
+		__atomic_fetch_and(&chunk->slab_map[page / 8], ~(1 << (page % 8)), __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * Returns nonzero if 'ptr' is the start of a slot of 'slab' that was handed out
+ * Only the position is checked, a slot freed twice is not detected
+ */
+static inline int slab_is_slot(mem_slab *slab, void *ptr){
+	char *first = (char*)slab + SLAB_HEADER_SIZE;
+
+	return (char*)ptr >= first && (char*)ptr < slab->unused && ((char*)ptr - first) % slab->slot_size == 0;
+}
+
+/*
+ * Returns nonzero if no slot of 'slab' is left to hand out
+ */
+static inline int slab_is_full(mem_slab *slab){
+	return slab->free_slots == NULL && slab->unused + slab->slot_size > (char*)slab + getpagesize() - HEADER_SIZE;
+}
+
+static void slab_link(mem_arena *arena, mem_slab *slab){
+	slab->prev = NULL;
+	slab->next = arena->slabs[slab->index];
+	if(slab->next != NULL) {
+		slab->next->prev = slab;
+	}
+	arena->slabs[slab->index] = slab;
+}
+
+static void slab_unlink(mem_arena *arena, mem_slab *slab){
+	if(slab->prev != NULL) {
+		slab->prev->next = slab->next;
+	}
+	else {
+		arena->slabs[slab->index] = slab->next;
+	}
+	if(slab->next != NULL) {
+		slab->next->prev = slab->prev;
+	}
+}
+
+/*
+ * Carves a new slab for class 'index' out of 'arena' and links it into the list of its class
+ * The caller must hold the lock of the arena
+ * Returns NULL if no page sized block with a page aligned payload fits
+ */
+static mem_slab *slab_create(mem_arena *arena, int index){
+	size_t pagesize = getpagesize();
+	block_tag *block;
+	mem_chunk *chunk;
+	mem_slab *slab;
+
+	block = heap_alloc_aligned(arena, pagesize, pagesize);
+	if(block == NULL) {
+		return NULL;
+	}
+	slab = (mem_slab*)(block + 1);
+
+	//the chunk of the block gets its slab map with its first slab
+	chunk = chunk_of(arena, block);
+	if(chunk->slab_map == NULL) {
+		unsigned char *map = map_region(slab_map_size(chunk));
+		if(map == NULL) {
+			heap_free(arena, block);
+			return NULL;
+		}
+		__atomic_store_n(&chunk->slab_map, map, __ATOMIC_RELEASE);
+	}
+
+	slab->chunk = chunk;
+	slab->free_slots = NULL;
+	slab->unused = (char*)slab + SLAB_HEADER_SIZE;
+	slab->slot_size = index * MEM_ALIGN;
+	slab->index = index;
+	slab->used = 0;
+	slab_mark(slab, 1);
+	slab_link(arena, slab);
+	return slab;
+}
+
+/*
+ * Takes a slot of class 'index' out of the slabs of 'arena', carving a new slab if none has a free slot
+ * The caller must hold the lock of the arena
+ * Returns NULL if there is no free slot and no room for a new slab
+ */
+static void *slab_alloc(mem_arena *arena, int index){
+	mem_slab *slab = arena->slabs[index];
+	void *slot;
+
+	if(slab == NULL && (slab = slab_create(arena, index)) == NULL) {
+		return NULL;
+	}
+
+	if(slab->free_slots != NULL) {
+		slot = slab->free_slots;
+		slab->free_slots = *(void**)slot;
+	}
+	else {
+		slot = slab->unused;
+		slab->unused += slab->slot_size;
+	}
+	slab->used++;
+
+	//a full slab leaves the list until one of its slots is freed
+	if(slab_is_full(slab)) {
+		slab_unlink(arena, slab);
+	}
+	return slot;
+}
+
+/*
+ * Gives a slot back to its slab, and the slab back to the heap once all its slots are free
+ * The caller must hold the lock of the arena
+ */
+static void slab_free(mem_arena *arena, mem_slab *slab, void *slot){
+	int wasFull = slab_is_full(slab);
+
+	*(void**)slot = slab->free_slots;
+	slab->free_slots = slot;
+	slab->used--;
+
+	if(slab->used == 0) {
+		if(!wasFull) {
+			slab_unlink(arena, slab);
+		}
+		slab_mark(slab, 0);
+		heap_free(arena, (block_tag*)slab - 1);
+	}
+	else if(wasFull) {
+		slab_link(arena, slab);
+	}
+}
+
+/*
+ * NUMA aware heaps, set up with MEM_INIT_NUMA
+ * Every online node gets an arena of its own placed on the node, the main
+ * arena serves the first one
+ * Mem_Alloc serves a thread from the arena of the node it runs on, looked up
+ * again every NUMA_RECHECK allocations in case the thread moved
+ * Mem_Free gives blocks of the local arena back right away, blocks of other
+ * nodes go onto the remote frees of their arena, which the threads of that
+ * node free the next time they take its lock, so a free never touches the
+ * lock or the free lists of a remote arena
+ */
+#define NUMA_RECHECK 1024
+
+static struct{
+
+  int count;                          /* arenas, 0 if the heap is not NUMA aware */
+  mem_arena *arenas[MEM_MAX_NODES];   /* by node, NULL for nodes without an arena */
+
+} numa;
+
+/* Node of the calling thread, -1 until it is looked up - fixed by Mem_SetThreadNode */
+static __thread int thread_node = -1;
+static __thread int thread_node_fixed;
+static __thread unsigned thread_node_age;
+
+static inline int current_node(void){
+	if(thread_node < 0 || (!thread_node_fixed && ++thread_node_age % NUMA_RECHECK == 0)) {
+		unsigned cpu, node;
+		thread_node = syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < MEM_MAX_NODES ? (int)node : 0;
+	}
+	return thread_node;
+}
+
+/*
+ * Returns the arena serving the calling thread, the main arena unless the heap is NUMA aware
+ */
+static inline mem_arena *local_arena(void){
+	mem_arena *arena;
+
+	if(numa.count <= 1) {
+		return &main_arena;
+	}
+	arena = numa.arenas[current_node()];
+	return arena != NULL ? arena : &main_arena;
+}
+
+/*
+ * Fills in 'nodes' with the online NUMA nodes below MEM_MAX_NODES, read from a list
+ * like "0-1,4" in sysfs
+ * Returns their number, at least 1 as node 0 is assumed if the list cannot be read
+ */
+static int numa_online(int nodes[MEM_MAX_NODES]){
+	FILE *file = fopen("/sys/devices/system/node/online", "r");
+	int count = 0;
+	int first;
+	int last;
+
+	if(file != NULL) {
+		while(count < MEM_MAX_NODES && fscanf(file, "%d", &first) == 1) {
+			last = first;
+			if(fscanf(file, "-%d", &last) != 1) {
+				last = first;
+			}
+			for(; first <= last && first < MEM_MAX_NODES && count < MEM_MAX_NODES; first++) {
+				nodes[count++] = first;
+			}
+			if(fgetc(file) != ',') {
+				break;
+			}
+		}
+		fclose(file);
+	}
+	if(count == 0) {
+		nodes[count++] = 0;
+	}
+	return count;
+}
+
+/*
+ * Per thread caches of small objects
+ * Objects of the main arena with room for at most TCACHE_MAX_SIZE bytes - slab
+ * slots and small blocks - are not given back when freed, they are kept in a
+ * list of the freeing thread, one list per multiple of MEM_ALIGN the object
+ * has room for
+ * Mem_Alloc and Mem_Free serve these sizes from the lists without taking the
+ * lock of the main arena, the arena is only locked to refill or drain TCACHE_BATCH objects at once
+ * The list links are kept in the first bytes of the objects
+ * Hardened builds cache nothing, for the same reason as the quick lists
+ */
+#ifdef MEM_HARDEN
+#define TCACHE_MAX_SIZE 0
+#else
+#define TCACHE_MAX_SIZE SLAB_MAX_SIZE
+#endif
+#define TCACHE_CLASSES SLAB_CLASSES
+#define TCACHE_BATCH 8
+#define TCACHE_LIMIT (2 * TCACHE_BATCH)
+
+typedef struct tcache{
+
+  void *heads[TCACHE_CLASSES];
+  int counts[TCACHE_CLASSES];
+  int registered;
+
+  /* Allocations and frees served by the cache, not yet added to the stats of the main arena */
+  size_t allocs;
+  size_t frees;
+
+#ifdef MEM_HARDEN
+  /* Blocks freed by the thread which are not given back yet, the oldest at quarantine_next */
+  void *quarantine[QUARANTINE_SIZE];
+  int quarantine_next;
+#endif
+
+} tcache;
+
+static __thread tcache thread_cache;
+
+/* Key used to drain the cache of a thread when it exits */
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+static inline void tcache_push(tcache *cache, int index, void *ptr){
+	*(void**)ptr = cache->heads[index];
+	cache->heads[index] = ptr;
+	cache->counts[index]++;
+}
+
+static inline void *tcache_pop(tcache *cache, int index){
+	void *ptr = cache->heads[index];
+	cache->heads[index] = *(void**)ptr;
+	cache->counts[index]--;
+	return ptr;
+}
+
+/*
+ * Adds the allocations and frees served by the cache to the stats of the main arena
+ * The caller must hold the lock of the main arena
+ */
+static inline void tcache_flush_stats(tcache *cache){
+	main_arena.stats.alloc_count += cache->allocs;
+	main_arena.stats.free_count += cache->frees;
+	cache->allocs = 0;
+	cache->frees = 0;
+}
+
+/*
+ * Gives up to 'count' objects of the list at 'index' back to their slabs or
+ * to the heap under a single acquisition of the lock of the main arena
+ */
+static void tcache_drain(tcache *cache, int index, int count){
+	arena_lock(&main_arena);
+	tcache_flush_stats(cache);
+	while(count-- > 0 && cache->heads[index] != NULL) {
+		void *ptr = tcache_pop(cache, index);
+		mem_slab *slab = slab_lookup(chunk_of(&main_arena, ptr), ptr);
+
+		if(slab != NULL) {
+			slab_free(&main_arena, slab, ptr);
+		}
+		else {
+			heap_release(&main_arena, (block_tag*)ptr - 1);
+		}
+	}
+	pthread_mutex_unlock(&main_arena.lock);
+}
+
+#ifdef MEM_HARDEN
+//the quarantine is emptied through the free path further down
+static void quarantine_flush(tcache *cache);
+#endif
+
+/*
+ * Destructor of tcache_key - gives every cached object of an exiting thread back to the main arena
+ */
+static void tcache_release(void *arg){
+	tcache *cache = arg;
+	int index;
+
+#ifdef MEM_HARDEN
+	quarantine_flush(cache);
+#endif
+	for(index = 0; index < TCACHE_CLASSES; index++) {
+		if(cache->heads[index] != NULL) {
+			tcache_drain(cache, index, cache->counts[index]);
+		}
+	}
+	if(cache->allocs != 0 || cache->frees != 0) {
+		arena_lock(&main_arena);
+		tcache_flush_stats(cache);
+		pthread_mutex_unlock(&main_arena.lock);
+	}
+}
+
+static void tcache_create_key(void){
+	pthread_key_create(&tcache_key, tcache_release);
+}
+
+/*
+ * Returns the cache of the calling thread
+ * Makes sure the cache is drained when the thread exits
+ */
+static inline tcache *get_tcache(void){
+	tcache *cache = &thread_cache;
+
+	if(!cache->registered) {
+		pthread_once(&tcache_key_once, tcache_create_key);
+		pthread_setspecific(tcache_key, cache);
+		cache->registered = 1;
+	}
+	return cache;
+}
+
+/*
+ * Allocates TCACHE_BATCH objects of index * MEM_ALIGN bytes under a single
+ * acquisition of the lock of the main arena, returns one of them and keeps the others in the cache
+ * Objects come from the slabs, or from the heap if there is no room for a slab or the build is hardened
+ * Returns NULL if not even one object could be allocated
+ */
+static void *tcache_refill(tcache *cache, int index){
+	size_t blockSize = ALIGN_UP(index * MEM_ALIGN + HEADER_SIZE + CANARY_SIZE, MEM_ALIGN);
+	void *ptr = NULL;
+	int count;
+
+	if(blockSize < MIN_BLOCK_SIZE) {
+		blockSize = MIN_BLOCK_SIZE;
+	}
+
+	arena_lock(&main_arena);
+	tcache_flush_stats(cache);
+	for(count = 0; count < TCACHE_BATCH; count++) {
+		//slots have no room for a canary
+		void *extra = CANARY_SIZE == 0 ? slab_alloc(&main_arena, index) : NULL;
+		if(extra == NULL) {
+			block_tag *block = heap_alloc(&main_arena, blockSize);
+			if(block == NULL) {
+				break;
+			}
+			extra = block + 1;
+		}
+		if(ptr == NULL) {
+			ptr = extra;
+		}
+		else {
+			tcache_push(cache, index, extra);
+		}
+	}
+	pthread_mutex_unlock(&main_arena.lock);
+	return ptr;
+}
+
+/*
+ * Allocation trace recording
+ * While a trace is running the allocation functions append an event to a
+ * buffer of the calling thread without taking any lock or touching shared
+ * data, apart from a single load of trace.enabled that is all they pay when no
+ * trace is running
+ * A full buffer is copied into the trace file, which is mapped shared, at an
+ * offset reserved with a single atomic add - the threads only share the lock
+ * which keeps Mem_TraceStop from unmapping the file under a copy
+ * The buffers of other threads are copied when they fill up or when their
+ * thread exits, the rest is copied by Mem_TraceStop, which finds every buffer
+ * in a list and waits for threads in the middle of an event
+ */
+#define TRACE_BUFFER_EVENTS 1024
+
+typedef struct trace_buffer{
+
+  struct mem_trace_event events[TRACE_BUFFER_EVENTS];
+  int count;
+  unsigned generation;    /* the trace the events belong to */
+  uint32_t thread;
+  int busy;               /* set while the thread appends an event */
+  struct trace_buffer *next, *prev;
+
+} trace_buffer;
+
+static struct{
+
+  int enabled;
+  unsigned generation;    /* counts the calls of Mem_TraceStart */
+  char *map;              /* the trace file, NULL if no trace is running */
+  size_t capacity;        /* bytes of the file */
+  size_t used;            /* bytes reserved by the buffers so far, may run past capacity */
+  size_t dropped;
+  uint32_t threads;
+  int fd;
+  pthread_rwlock_t lock;  /* held shared while copying into the file */
+  trace_buffer *buffers;  /* the buffers of all threads */
+  pthread_mutex_t buffers_lock;
+
+} trace = { .lock = PTHREAD_RWLOCK_INITIALIZER, .buffers_lock = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread trace_buffer *thread_trace;
+
+/* Key used to copy the buffer of a thread into the file when it exits */
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static inline uint64_t trace_clock(void){
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+/*
+ * Copies the events of 'buffer' into the trace file and empties the buffer
+ * Events which do not fit anymore, or which belong to an earlier trace, are dropped
+ * trace.lock has to be held, shared or not
+ */
+static void trace_copy(trace_buffer *buffer){
+	size_t bytes = buffer->count * sizeof(struct mem_trace_event);
+
+	if(trace.map != NULL && buffer->generation == trace.generation) {
+		size_t offset = __atomic_fetch_add(&trace.used, bytes, __ATOMIC_RELAXED);
+		size_t room = offset < trace.capacity ? trace.capacity - offset : 0;
+
+		//copy what fits, the space of the file is used up to the last event
+		if(room < bytes) {
+			__atomic_fetch_add(&trace.dropped, (bytes - room) / sizeof(struct mem_trace_event), __ATOMIC_RELAXED);
+			bytes = room;
+		}
+		memcpy(trace.map + offset, buffer->events, bytes);
+	}
+	buffer->count = 0;
+}
+
+static void trace_flush(trace_buffer *buffer){
+	pthread_rwlock_rdlock(&trace.lock);
+	trace_copy(buffer);
+	pthread_rwlock_unlock(&trace.lock);
+}
+
+/*
+ * Destructor of trace_key - copies the buffer of an exiting thread into the file and unmaps it
+ */
+static void trace_release(void *arg){
+	trace_buffer *buffer = arg;
+
+	pthread_mutex_lock(&trace.buffers_lock);
+	if(buffer->prev != NULL) {
+		buffer->prev->next = buffer->next;
+	}
+	else {
+		trace.buffers = buffer->next;
+	}
+	if(buffer->next != NULL) {
+		buffer->next->prev = buffer->prev;
+	}
+	if(buffer->count != 0) {
+		trace_flush(buffer);
+	}
+	pthread_mutex_unlock(&trace.buffers_lock);
+	thread_trace = NULL;
+	munmap(buffer, round_to_pages(sizeof(trace_buffer)));
+}
+
+static void trace_create_key(void){
+	pthread_key_create(&trace_key, trace_release);
+}
+
+/*
+ * Appends an event to the buffer of the calling thread, the buffer is mapped on the first event
+ * The buffer is marked busy before trace.enabled is checked again, so Mem_TraceStop,
+ * which clears trace.enabled before it looks at the marks, either waits for the
+ * event or the event is not recorded
+ */
+static void trace_record(uint32_t op, void *ptr, void *old, size_t size){
+	trace_buffer *buffer = thread_trace;
+	unsigned generation;
+
+	if(buffer == NULL) {
+		buffer = map_region(round_to_pages(sizeof(trace_buffer)));
+		if(buffer == NULL) {
+			return;
+		}
+		pthread_once(&trace_key_once, trace_create_key);
+		pthread_setspecific(trace_key, buffer);
+		thread_trace = buffer;
+		pthread_mutex_lock(&trace.buffers_lock);
+		buffer->next = trace.buffers;
+		if(trace.buffers != NULL) {
+			trace.buffers->prev = buffer;
+		}
+		trace.buffers = buffer;
+		pthread_mutex_unlock(&trace.buffers_lock);
+	}
+	__atomic_store_n(&buffer->busy, 1, __ATOMIC_SEQ_CST);
+	if(!__atomic_load_n(&trace.enabled, __ATOMIC_SEQ_CST)) {
+		__atomic_store_n(&buffer->busy, 0, __ATOMIC_RELEASE);
+		return;
+	}
+	generation = __atomic_load_n(&trace.generation, __ATOMIC_RELAXED);
+	if(buffer->generation != generation) {
+		buffer->count = 0;
+		buffer->generation = generation;
+		buffer->thread = __atomic_fetch_add(&trace.threads, 1, __ATOMIC_RELAXED);
+	}
+
+	struct mem_trace_event *event = &buffer->events[buffer->count++];
+	event->time = trace_clock();
+	event->ptr = (uintptr_t)ptr;
+	event->old = (uintptr_t)old;
+	event->size = size;
+	event->op = op;
+	event->thread = buffer->thread;
+
+	if(buffer->count == TRACE_BUFFER_EVENTS) {
+		trace_flush(buffer);
+	}
+	__atomic_store_n(&buffer->busy, 0, __ATOMIC_RELEASE);
+}
+
+static inline void trace_event(uint32_t op, void *ptr, void *old, size_t size){
+	if(__builtin_expect(__atomic_load_n(&trace.enabled, __ATOMIC_RELAXED), 0)) {
+		trace_record(op, ptr, old, size);
+	}
+}
+
+/*
+ * Huge blocks
+ * Requests of at least huge.threshold bytes to Mem_Alloc, Mem_AllocAligned and
+ * Mem_Realloc get a mapping of their own instead of a block of the main arena,
+ * Mem_Free unmaps it right away, so big buffers neither use up the region nor
+ * leave a hole in it once freed
+ * The mapping starts with a huge_block, the header of the block is right in
+ * front of the payload (at 'offset') and has HUGE_BLOCK set besides BUSY
+ * HUGE_BLOCK is the top bit of size_status, which no block of a heap reaches
+ * The flag alone cannot tell a stray pointer from a huge block without reading
+ * memory which may not be mapped, so huge blocks are also kept in a list
+ */
+#define HUGE_BLOCK ((size_t)1 << (SIZE_BITS - 1))
+
+//threshold of growable heaps, fixed heaps keep everything in their region until Mem_SetHugeThreshold is called
+#define MEM_HUGE_THRESHOLD (256 * 1024)
+
+typedef struct huge_block{
+
+  struct huge_block *next;
+  struct huge_block *prev;
+  size_t map_size;
+  size_t offset;
+
+} huge_block;
+
+static struct{
+
+  huge_block *list;
+  size_t threshold;       /* 0 if there are no huge blocks */
+  size_t count;
+  size_t bytes;           /* mapped for huge blocks */
+  size_t alloc_count;
+  size_t free_count;
+  pthread_mutex_t lock;
+
+} huge = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static inline block_tag *huge_header(huge_block *block){
+	return (block_tag*)((char*)block + block->offset) - 1;
+}
+
+/*
+ * Returns true if a request of 'size' bytes gets a huge block
+ */
+static inline int huge_wanted(size_t size){
+	size_t threshold = __atomic_load_n(&huge.threshold, __ATOMIC_RELAXED);
+
+	return threshold != 0 && size >= threshold;
+}
+
+/*
+ * Returns the huge block whose payload is at 'ptr', NULL if there is none
+ * The caller must hold huge.lock
+ */
+static huge_block *huge_find(void *ptr){
+	huge_block *block;
+
+	for(block = huge.list; block != NULL; block = block->next) {
+		if((char*)block + block->offset == (char*)ptr) {
+			return (huge_header(block)->size_status & HUGE_BLOCK) ? block : NULL;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Maps a huge block for 'size' bytes with the payload aligned to 'alignment', at most the page size
+ * Returns the address of the payload on success and NULL on failure
+ */
+static void *huge_alloc(size_t size, size_t alignment){
+	size_t offset = ALIGN_UP(sizeof(huge_block) + HEADER_SIZE, alignment);
+	size_t mapSize;
+	huge_block *block;
+
+	if(size > MAX_BLOCK_SIZE - offset) {
+		return NULL;
+	}
+	mapSize = round_to_pages(offset + size);
+	block = map_region(mapSize);
+	if(block == NULL) {
+		return NULL;
+	}
+	block->map_size = mapSize;
+	block->offset = offset;
+	huge_header(block)->size_status = (mapSize - offset + HEADER_SIZE) | HUGE_BLOCK | BUSY;
+
+	pthread_mutex_lock(&huge.lock);
+	block->prev = NULL;
+	block->next = huge.list;
+	if(huge.list != NULL) {
+		huge.list->prev = block;
+	}
+	huge.list = block;
+	huge.count++;
+	huge.bytes += mapSize;
+	huge.alloc_count++;
+	pthread_mutex_unlock(&huge.lock);
+	return (char*)block + offset;
+}
+
+/*
+ * Unmaps the huge block at 'ptr'
+ * Returns 0 on success and -1 if 'ptr' is not the payload of a huge block
+ */
+static int huge_free(void *ptr){
+	huge_block *block;
+
+	pthread_mutex_lock(&huge.lock);
+	block = huge_find(ptr);
+	if(block == NULL) {
+		pthread_mutex_unlock(&huge.lock);
+		return -1;
+	}
+	if(block->prev != NULL) {
+		block->prev->next = block->next;
+	}
+	else {
+		huge.list = block->next;
+	}
+	if(block->next != NULL) {
+		block->next->prev = block->prev;
+	}
+	huge.count--;
+	huge.bytes -= block->map_size;
+	huge.free_count++;
+	pthread_mutex_unlock(&huge.lock);
+
+	munmap(block, block->map_size);
+	return 0;
+}
+
+/*
+ * Resizes the huge block at 'ptr' to 'size' bytes with mremap, the kernel
+ * moves the pages instead of copying them if the mapping cannot grow in place
+ * Returns the address of the payload on success
+ * Returns NULL if 'ptr' is not a huge block, if 'size' is too small for a huge
+ * block or if the mapping cannot be resized, and stores the room of the block
+ * in 'room' if it is one
+ */
+static void *huge_resize(void *ptr, size_t size, size_t *room){
+	huge_block *block;
+	huge_block *moved;
+	size_t mapSize;
+
+	pthread_mutex_lock(&huge.lock);
+	block = huge_find(ptr);
+	if(block == NULL) {
+		pthread_mutex_unlock(&huge.lock);
+		return NULL;
+	}
+	*room = block->map_size - block->offset;
+	if(!huge_wanted(size) || size > MAX_BLOCK_SIZE - block->offset) {
+		pthread_mutex_unlock(&huge.lock);
+		return NULL;
+	}
+	mapSize = round_to_pages(block->offset + size);
+	moved = mremap(block, block->map_size, mapSize, MREMAP_MAYMOVE);
+	if(moved == MAP_FAILED) {
+		pthread_mutex_unlock(&huge.lock);
+		return NULL;
+	}
+
+	//the neighbours in the list have to follow the block if it moved
+	if(moved->prev != NULL) {
+		moved->prev->next = moved;
+	}
+	else {
+		huge.list = moved;
+	}
+	if(moved->next != NULL) {
+		moved->next->prev = moved;
+	}
+	huge.bytes += mapSize - moved->map_size;
+	moved->map_size = mapSize;
+	huge_header(moved)->size_status = (mapSize - moved->offset + HEADER_SIZE) | HUGE_BLOCK | BUSY;
+	pthread_mutex_unlock(&huge.lock);
+	return (char*)moved + moved->offset;
+}
+
+/*
+ * Returns the size of the block needed for a payload of 'size' bytes
+ * Returns 0 if 'size' is 0 or can never fit in 'arena'
+ */
+static size_t round_size(mem_arena *arena, size_t size){
+
+	//size must be positive and can never fit if it is bigger than the heap
+	if(size == 0 || size > MAX_BLOCK_SIZE - MIN_BLOCK_SIZE || (!arena->growable && size > arena->total_mem_size)) {
+		return 0;
+	}
+
+	//size of allocation is requested size plus a header (and the canary), rounded up to a multiple of MEM_ALIGN
+	size = ALIGN_UP(size + HEADER_SIZE + CANARY_SIZE, MEM_ALIGN);
+
+	//the block has to be big enough to hold the free list links once it is freed again
+	if(size < MIN_BLOCK_SIZE) {
+		size = MIN_BLOCK_SIZE;
+	}
+	return size;
+}
+
+/*
+ * Counts a failed allocation of 'size' bytes in the stats of 'arena', requests of 0 bytes are not counted
+ * Returns NULL
+ */
+static void *alloc_failed(mem_arena *arena, size_t size){
+	if(size != 0) {
+		__atomic_fetch_add(&arena->stats.failed_allocs, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/*
+ * Function for allocating 'size' bytes
+ * Returns address of the payload in the allocated block on success 
+ * Returns NULL on failure 
+ * Here is what this function should accomplish 
+ * - If size is 0 - Return NULL
+ * - Round up size to a multiple of MEM_ALIGN 
+ * - Look up the best free block which can accommodate the requested size in the size class bins
+ * - Also, when allocating a block - split it into two blocks when possible 
+ * Sizes from the huge threshold up get a mapping of their own
+ * In a NUMA aware heap the arena of the node of the calling thread is used
+ * Small sizes are served from the cache of the calling thread when possible,
+ * which is refilled from the slabs
+ * Tips: Be careful with pointer arithmetic 
+ */
+static void *alloc_main(size_t size){
+	block_tag *newBlock;
+	size_t blockSize;
+
+	if(huge_wanted(size)) {
+		void *ptr = huge_alloc(size, MEM_ALIGN);
+		return ptr != NULL ? ptr : alloc_failed(&main_arena, size);
+	}
+
+	//threads of other NUMA nodes are served by the arena of their node, the main arena only steps in when it is full
+	mem_arena *arena = local_arena();
+	if(arena != &main_arena) {
+		blockSize = round_size(arena, size);
+		if(blockSize != 0) {
+			arena_lock(arena);
+			newBlock = heap_alloc(arena, blockSize);
+			arena->stats.alloc_count += newBlock != NULL;
+			pthread_mutex_unlock(&arena->lock);
+			if(newBlock != NULL) {
+				return (char*)newBlock + HEADER_SIZE;
+			}
+		}
+	}
+
+	blockSize = round_size(&main_arena, size);
+	if(blockSize == 0) {
+		return alloc_failed(&main_arena, size);
+	}
+
+	if(size <= TCACHE_MAX_SIZE && persist.super == NULL) {
+		int index = ALIGN_UP(size, MEM_ALIGN) / MEM_ALIGN;
+		tcache *cache = get_tcache();
+		void *ptr;
+
+		if(cache->heads[index] != NULL) {
+			cache->allocs++;
+			return tcache_pop(cache, index);
+		}
+		ptr = tcache_refill(cache, index);
+		if(ptr != NULL) {
+			cache->allocs++;
+			return ptr;
+		}
+		newBlock = NULL;
+	}
+	else {
+		arena_lock(&main_arena);
+		newBlock = heap_alloc(&main_arena, blockSize);
+		main_arena.stats.alloc_count += newBlock != NULL;
+		pthread_mutex_unlock(&main_arena.lock);
+	}
+
+	//objects held in the cache of this thread may be what keeps the free space apart
+	if(newBlock == NULL && thread_cache.registered) {
+		tcache_release(&thread_cache);
+		arena_lock(&main_arena);
+		newBlock = heap_alloc(&main_arena, blockSize);
+		main_arena.stats.alloc_count += newBlock != NULL;
+		pthread_mutex_unlock(&main_arena.lock);
+	}
+
+	if(newBlock == NULL) {
+		return alloc_failed(&main_arena, size);
+	}
+	return (char*)newBlock + HEADER_SIZE;
+}
+
+/*
+ * Function for allocating 'size' bytes, see alloc_main
+ * The allocation is recorded if a trace is running
+ */
+void* Mem_Alloc(size_t size){
+	void *ptr = alloc_main(size);
+
+	if(ptr != NULL) {
+		trace_event(MEM_TRACE_ALLOC, ptr, NULL, size);
+	}
+	return ptr;
+}
+
+/*
+ * Function for allocating 'count' objects of 'size' bytes each, all of them zero
+ * Returns address of the payload in the allocated block on success 
+ * Returns NULL on failure, also if 'count' * 'size' overflows
+ * The heap is mapped zeroed, so memory no block was handed out from before reads
+ * as zeroes apart from the links and footer the free block kept there, and only
+ * those and the memory which was used before are cleared, see mem_chunk.untouched
+ * Huge blocks are fresh mappings and are not cleared at all
+ * The allocation is recorded if a trace is running
+ */
+void* Mem_Calloc(size_t count, size_t size){
+	size_t total;
+	size_t cleared;
+	char *ptr;
+
+	if(__builtin_mul_overflow(count, size, &total)) {
+		return alloc_failed(&main_arena, 1);
+	}
+	carved_untouched = NULL;
+	ptr = alloc_main(total);
+	if(ptr == NULL) {
+		return NULL;
+	}
+
+	char *untouched = carved_untouched;
+	if(huge_wanted(total)) {
+		cleared = 0;
+	}
+	else if(total <= TCACHE_MAX_SIZE || untouched < ptr || untouched >= ptr + total) {
+		cleared = total;
+		memset(ptr, 0, total);
+	}
+	else {
+		//whatever is below the mark, the links of the free block at the mark, and the footer
+		char *end = ptr + total;
+		char *links = end - untouched < sizeof(tree_block) ? end : untouched + sizeof(tree_block);
+		char *footer = (char*)next_block((block_tag*)ptr - 1) - HEADER_SIZE;
+
+		memset(ptr, 0, links - ptr);
+		cleared = links - ptr;
+		if(footer < end) {
+			memset(footer, 0, end - footer);
+			cleared += end - footer;
+		}
+	}
+	__atomic_fetch_add(&main_arena.stats.calloc_cleared, cleared, __ATOMIC_RELAXED);
+	trace_event(MEM_TRACE_ALLOC, ptr, NULL, total);
+	return ptr;
+}
+
+/*
+ * Function for allocating 'size' bytes from 'arena'
+ * Same as Mem_Alloc but without the thread caches, the arena lock is only
+ * contended by the threads sharing the arena
+ */
+void* Mem_ArenaAlloc(mem_arena *arena, size_t size){
+	block_tag *newBlock;
+	size_t blockSize;
+
+	if(arena == NULL) {
+		return NULL;
+	}
+	blockSize = round_size(arena, size);
+	if(blockSize == 0) {
+		return alloc_failed(arena, size);
+	}
+
+	arena_lock(arena);
+	newBlock = heap_alloc(arena, blockSize);
+	arena->stats.alloc_count += newBlock != NULL;
+	pthread_mutex_unlock(&arena->lock);
+
+	if(newBlock == NULL) {
+		return alloc_failed(arena, size);
+	}
+	return (char*)newBlock + HEADER_SIZE;
+}
+
+/*
+ * Clears the 'n' entries of 'out' and counts a failed batch allocation
+ * Returns -1
+ */
+static int batch_failed(void *out[], size_t n){
+	size_t i;
+
+	for(i = 0; i < n; i++) {
+		out[i] = NULL;
+	}
+	alloc_failed(&main_arena, n);
+	return -1;
+}
+
+/*
+ * Function for allocating 'n' blocks at once, 'sizes[i]' bytes for block 'i'
+ * Stores the addresses of the payloads in 'out'
+ * Returns 0 on success
+ * Returns -1 on failure, then nothing is allocated and 'out' is filled with NULL
+ * All blocks are carved one after the other out of a single free block found
+ * with a single search of the heap, so they end up next to each other in
+ * order and Mem_FreeBatch can coalesce them in one go
+ * If no free block can hold all of them, they are allocated one by one, still
+ * under a single acquisition of the lock
+ */
+int Mem_AllocBatch(const size_t sizes[], size_t n, void *out[]){
+	size_t total = 0;
+	size_t i;
+	block_tag *block;
+
+	if(sizes == NULL || out == NULL || n == 0) {
+		return -1;
+	}
+	for(i = 0; i < n; i++) {
+		size_t blockSize = round_size(&main_arena, sizes[i]);
+		if(blockSize == 0 || blockSize > MAX_BLOCK_SIZE - total) {
+			return batch_failed(out, n);
+		}
+		total += blockSize;
+	}
+
+	arena_lock(&main_arena);
+	block = heap_alloc(&main_arena, total);
+	if(block != NULL) {
+		//split the block into the busy blocks of the batch, the last one takes what is left
+		size_t rest = block_size(block);
+		size_t prevBusy = block->size_status & PREV_BUSY;
+		for(i = 0; i < n; i++) {
+			size_t blockSize = i == n - 1 ? rest : round_size(&main_arena, sizes[i]);
+			block->size_status = blockSize + BUSY + prevBusy;
+			harden_seal(block);
+			out[i] = (char*)block + HEADER_SIZE;
+			rest -= blockSize;
+			block = next_block(block);
+			prevBusy = PREV_BUSY;
+		}
+	}
+	else {
+		for(i = 0; i < n; i++) {
+			block = heap_alloc(&main_arena, round_size(&main_arena, sizes[i]));
+			if(block == NULL) {
+				while(i-- > 0) {
+					heap_free(&main_arena, (block_tag*)out[i] - 1);
+				}
+				pthread_mutex_unlock(&main_arena.lock);
+				return batch_failed(out, n);
+			}
+			out[i] = (char*)block + HEADER_SIZE;
+		}
+	}
+	main_arena.stats.alloc_count += n;
+	pthread_mutex_unlock(&main_arena.lock);
+
+	for(i = 0; i < n; i++) {
+		trace_event(MEM_TRACE_ALLOC, out[i], NULL, sizes[i]);
+	}
+	return 0;
+}
+
+/*
+ * Function for allocating 'size' bytes with the payload aligned to 'alignment'
+ * 'alignment' must be a power of two no bigger than the page size
+ * Returns address of the payload in the allocated block on success 
+ * Returns NULL on failure 
+ * The block is taken from the best fitting free block, the padding in front
+ * of the aligned payload stays free, and Mem_Free frees the block as usual
+ */
+void* Mem_AllocAligned(size_t size, size_t alignment){
+	block_tag *newBlock;
+	size_t blockSize;
+
+	if(alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > (size_t)getpagesize()) {
+		return alloc_failed(&main_arena, size);
+	}
+	if(alignment <= MEM_ALIGN) {
+		return Mem_Alloc(size);
+	}
+	if(huge_wanted(size)) {
+		void *ptr = huge_alloc(size, alignment);
+		if(ptr == NULL) {
+			return alloc_failed(&main_arena, size);
+		}
+		trace_event(MEM_TRACE_ALLOC, ptr, NULL, size);
+		return ptr;
+	}
+	blockSize = round_size(&main_arena, size);
+	if(blockSize == 0) {
+		return alloc_failed(&main_arena, size);
+	}
+
+	arena_lock(&main_arena);
+	newBlock = heap_alloc_aligned(&main_arena, blockSize, alignment);
+	main_arena.stats.alloc_count += newBlock != NULL;
+	pthread_mutex_unlock(&main_arena.lock);
+
+	if(newBlock == NULL) {
+		return alloc_failed(&main_arena, size);
+	}
+	trace_event(MEM_TRACE_ALLOC, newBlock + 1, NULL, size);
+	return (char*)newBlock + HEADER_SIZE;
+}
+
+/*
+ * Returns the arena whose region contains 'ptr' and stores the chunk holding it in 'chunk'
+ * Returns NULL if 'ptr' is not inside any arena
+ */
+static mem_arena *find_arena(void *ptr, mem_chunk **chunk){
+	mem_arena *arena;
+	mem_chunk *found;
+	unsigned seq;
+
+	do {
+		int low = 0;
+		int high = __atomic_load_n(&region_count, __ATOMIC_RELAXED);
+
+		seq = __atomic_load_n(&region_seq, __ATOMIC_ACQUIRE);
+		arena = NULL;
+		found = NULL;
+		//the last entry starting at or below ptr is the only one which can hold it
+		while(low < high) {
+			int mid = (low + high) / 2;
+			if((char*)ptr < __atomic_load_n(&regions[mid].start, __ATOMIC_RELAXED)) {
+				high = mid;
+			}
+			else {
+				low = mid + 1;
+			}
+		}
+		if(low > 0 && (char*)ptr < __atomic_load_n(&regions[low - 1].end, __ATOMIC_RELAXED)) {
+			arena = __atomic_load_n(&regions[low - 1].arena, __ATOMIC_RELAXED);
+			found = __atomic_load_n(&regions[low - 1].chunk, __ATOMIC_RELAXED);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while((seq & 1) != 0 || seq != __atomic_load_n(&region_seq, __ATOMIC_RELAXED));
+
+	if(arena != NULL) {
+		*chunk = found;
+	}
+	return arena;
+}
+
+/*
+ * Checks that 'ptr' is the payload of a busy block of 'chunk'
+ * Besides range and alignment, the header has to describe a busy block that
+ * ends inside the chunk, and the block following it has to agree that its
+ * previous block is busy - a pointer into the middle of a block, into a free
+ * block or at a corrupted header fails these checks
+ * Returns the header of the block on success
+ * Returns NULL on failure
+ */
+static block_tag *check_free(mem_chunk *chunk, void *ptr){
+
+	//Return NULL if ptr is NULL	
+	if(ptr == NULL) {
+		return NULL;
+	}
+
+	//Return NULL if ptr is not within the range of memory allocated for the chunk
+	uintptr_t epilogue = (uintptr_t)chunk->first_block + chunk->size - HEADER_SIZE;
+ 	if((uintptr_t)ptr < (uintptr_t)chunk->first_block + HEADER_SIZE || (uintptr_t)ptr > epilogue) {
+		return NULL;
+	}
+
+	//Return NULL if ptr is not MEM_ALIGN byte aligned
+	if((uintptr_t)ptr % MEM_ALIGN != 0) {
+		return NULL;
+	}
+
+	//This points to the header of the block the user wants to free 
+	block_tag *blockToFree = (block_tag*)((char*)ptr - HEADER_SIZE);
+	size_t status = blockToFree->size_status;
+	size_t size = status & ~STATUS_BITS;
+
+	//Return NULL if the block is not busy or its size does not fit in the chunk
+	if(!(status & BUSY) || size < MIN_BLOCK_SIZE || size % MEM_ALIGN != 0 || size > epilogue - (uintptr_t)blockToFree) {
+		return NULL;
+	}
+
+	//Return NULL if the next block does not know this block as busy
+	if(!(((block_tag*)((char*)blockToFree + size))->size_status & PREV_BUSY)) {
+		return NULL;
+	}
+#ifdef MEM_HARDEN
+	//Return NULL if the block waits in the quarantine, end the program if it is damaged
+	if(!harden_check(blockToFree)) {
+		return NULL;
+	}
+#endif
+	return blockToFree;
+}
+
+/*
+ * Puts the object at 'ptr' of the main arena, with room for at least
+ * 'index' * MEM_ALIGN bytes, into the cache list at 'index' of the calling thread
+ */
+static inline void tcache_free(void *ptr, int index){
+	tcache *cache = get_tcache();
+
+	tcache_push(cache, index, ptr);
+	cache->frees++;
+
+	//give a batch back once the list grows too long
+	if(cache->counts[index] > TCACHE_LIMIT) {
+		tcache_drain(cache, index, TCACHE_BATCH);
+	}
+}
+
+/*
+ * Function for freeing up a previously allocated block 
+ * Argument - ptr: Address of the payload of the allocated block to be freed up 
+ * Returns 0 on success 
+ * Returns -1 on failure 
+ * Here is what this function should accomplish 
+ * - Return -1 if ptr is NULL
+ * - Return -1 if ptr is not within the range of memory allocated by Mem_Init() or Mem_ArenaCreate()
+ * - Return -1 if ptr is not MEM_ALIGN byte aligned
+ * - Mark the block as free 
+ * - Coalesce if one or both of the immediate neighbours are free 
+ * - Put the coalesced block into the bin for its size
+ * The owning arena is looked up in the address range table, pointers outside
+ * of every arena may be huge blocks, which are unmapped
+ * Slab slots are recognized by the slab map of the chunk, the slab tells the size of the slot
+ * Slots and small blocks of the main arena are kept in the cache of the calling thread
+ * instead, they are only freed when the cache is drained
+ * Blocks of the main arena too big for the cache and blocks of other arenas are left to the
+ * holder of the lock of their arena when it is taken, and in a NUMA aware heap blocks of
+ * the arena of another node always are
+ */
+static int free_now(void *ptr){
+	mem_chunk *chunk;
+	mem_arena *arena = find_arena(ptr, &chunk);
+
+	if(arena == NULL) {
+		return ptr != NULL ? huge_free(ptr) : -1;
+	}
+	if(arena != &main_arena) {
+		if(arena->node >= 0 && arena != local_arena()) {
+			block_tag *blockToFree = check_free(chunk, ptr);
+			if(blockToFree == NULL) {
+				return -1;
+			}
+			free_remote(arena, blockToFree);
+			return 0;
+		}
+		return Mem_ArenaFree(arena, ptr);
+	}
+
+	int index;
+	mem_slab *slab = slab_lookup(chunk, ptr);
+	if(slab != NULL) {
+		//Return -1 if ptr is not the start of a slot
+		if(!slab_is_slot(slab, ptr)) {
+			return -1;
+		}
+		index = slab->index;
+	}
+	else {
+		block_tag *blockToFree = check_free(chunk, ptr);
+		if(blockToFree == NULL) {
+			return -1;
+		}
+
+		//the cache list of a block is the biggest size its payload has room for
+		size_t room = block_size(blockToFree) - HEADER_SIZE - CANARY_SIZE;
+		if(room > TCACHE_MAX_SIZE && numa.count > 1 && local_arena() != &main_arena) {
+			free_remote(arena, blockToFree);
+			return 0;
+		}
+		if(room > TCACHE_MAX_SIZE || persist.super != NULL) {
+			arena_free(arena, blockToFree);
+			return 0;
+		}
+		index = room / MEM_ALIGN;
+	}
+
+	tcache_free(ptr, index);
+
+	//Returns 0 on success
+	return 0;
+}
+
+#ifdef MEM_HARDEN
+/*
+ * Turns the canary of the busy block 'block' into the one of a block in the quarantine, or back
+ */
+static inline void quarantine_mark(block_tag *block){
+	*harden_tail(block) = ~*harden_tail(block);
+}
+
+/*
+ * Puts the block at 'ptr' into the quarantine of the calling thread
+ * Returns the block which leaves the quarantine to be freed now, NULL if there is none,
+ * and 'ptr' itself if it is no block of an arena (huge blocks are not quarantined)
+ * Returns (void*)-1 if 'ptr' cannot be freed
+ */
+static void *quarantine_swap(void *ptr){
+	block_tag *block;
+	mem_chunk *chunk;
+	tcache *cache;
+	void *oldest;
+
+	if(find_arena(ptr, &chunk) == NULL) {
+		return ptr;
+	}
+	block = check_free(chunk, ptr);
+	if(block == NULL) {
+		return (void*)-1;
+	}
+	quarantine_mark(block);
+
+	cache = get_tcache();
+	oldest = cache->quarantine[cache->quarantine_next];
+	cache->quarantine[cache->quarantine_next] = ptr;
+	cache->quarantine_next = (cache->quarantine_next + 1) % QUARANTINE_SIZE;
+
+	//a block written to after it was freed has lost its canary
+	if(oldest != NULL) {
+		block = (block_tag*)oldest - 1;
+		quarantine_mark(block);
+		if(*harden_tail(block) != harden_canary(block)) {
+			harden_abort(block, "Heap corruption - block written after it was freed");
+		}
+	}
+	return oldest;
+}
+
+/*
+ * Frees every block in the quarantine of 'cache'
+ */
+static void quarantine_flush(tcache *cache){
+	int i;
+
+	for(i = 0; i < QUARANTINE_SIZE; i++) {
+		void *ptr = cache->quarantine[i];
+		if(ptr != NULL) {
+			cache->quarantine[i] = NULL;
+			quarantine_mark((block_tag*)ptr - 1);
+			free_now(ptr);
+		}
+	}
+}
+#endif
+
+/*
+ * Function for freeing up a previously allocated block, see free_now
+ * Hardened builds keep the block in the quarantine and free the one leaving it instead
+ */
+static inline int free_main(void *ptr){
+#ifdef MEM_HARDEN
+	if(ptr == NULL) {
+		return -1;
+	}
+	ptr = quarantine_swap(ptr);
+	if(ptr == (void*)-1) {
+		return -1;
+	}
+	if(ptr == NULL) {
+		return 0;
+	}
+#endif
+	return free_now(ptr);
+}
+
+/*
+ * Function for freeing up a previously allocated block, see free_main
+ * The free is recorded if a trace is running
+ */
+int Mem_Free(void *ptr){
+	int result = free_main(ptr);
+
+	if(result == 0) {
+		trace_event(MEM_TRACE_FREE, ptr, NULL, 0);
+	}
+	return result;
+}
+
+/*
+ * Function for freeing up a block allocated with Mem_Alloc, Mem_Calloc,
+ * Mem_AllocAligned or Mem_Realloc for 'size' bytes, the size it was last given
+ * Returns 0 on success
+ * Returns -1 on failure, with the same checks as Mem_Free for the sizes which are not cached
+ * Sizes served from the thread caches go straight back into the cache of
+ * the calling thread once the pointer is found in a chunk of the main arena,
+ * without looking up the slab or the header of the block, so the size must be
+ * right, and like any cached object the block is not checked for a double free
+ * Pointers anywhere else - other arenas, shared heaps, huge blocks, or any
+ * pointer before Mem_Init - are left to Mem_Free, but a pointer into the middle
+ * of a block of the main arena, as those of a scratch arena are, is not caught
+ * Hardened builds, NUMA aware heaps and persistent heaps always check like Mem_Free
+ */
+int Mem_FreeSized(void *ptr, size_t size){
+#ifndef MEM_HARDEN
+	mem_chunk *chunk;
+
+	if(ptr != NULL && size != 0 && size <= TCACHE_MAX_SIZE && numa.count <= 1 && persist.super == NULL
+	   && find_arena(ptr, &chunk) == &main_arena) {
+		//the list of the smallest block 'size' can have, like free_now
+		tcache_free(ptr, (round_size(&main_arena, size) - HEADER_SIZE - CANARY_SIZE) / MEM_ALIGN);
+		trace_event(MEM_TRACE_FREE, ptr, NULL, 0);
+		return 0;
+	}
+#endif
+	return Mem_Free(ptr);
+}
+
+/*
+ * Function for freeing up a block allocated from 'arena'
+ * If another thread holds the lock of the arena the block is left to it, see arena_free
+ * Returns 0 on success 
+ * Returns -1 on failure, with the same checks as Mem_Free
+ */
+int Mem_ArenaFree(mem_arena *arena, void *ptr){
+	block_tag *blockToFree;
+	mem_chunk *chunk;
+
+	if(arena == NULL || find_arena(ptr, &chunk) != arena) {
+		return -1;
+	}
+	blockToFree = check_free(chunk, ptr);
+	if(blockToFree == NULL) {
+		return -1;
+	}
+
+	arena_free(arena, blockToFree);
+	return 0;
+}
+
+/*
+ * Orders pointers by address for qsort
+ */
+static int compare_ptrs(const void *a, const void *b){
+	uintptr_t left = (uintptr_t)*(void* const*)a;
+	uintptr_t right = (uintptr_t)*(void* const*)b;
+
+	return left < right ? -1 : left > right;
+}
+
+/*
+ * Function for freeing up 'n' previously allocated blocks at once
+ * Returns 0 on success
+ * Returns -1 if any of the pointers fails the checks of Mem_Free, the others are still freed
+ * 'ptrs' is sorted by address in place
+ * Runs of blocks of the main arena which follow each other in memory are
+ * merged into a single block and freed - and coalesced - once, under a single
+ * acquisition of the lock
+ * Pointers to slab slots or into other arenas are freed one by one with Mem_Free
+ * With MEM_HARDEN every block passes the quarantine and nothing is merged
+ */
+int Mem_FreeBatch(void *ptrs[], size_t n){
+	int result = 0;
+	size_t i = 0;
+
+	if(ptrs == NULL) {
+		return -1;
+	}
+	qsort(ptrs, n, sizeof(void*), compare_ptrs);
+
+#ifdef MEM_HARDEN
+	for(i = 0; i < n; i++) {
+		if(Mem_Free(ptrs[i]) != 0) {
+			result = -1;
+		}
+	}
+#else
+	while(i < n) {
+		mem_chunk *chunk;
+		mem_arena *arena = find_arena(ptrs[i], &chunk);
+		block_tag *run;
+
+		if(arena != &main_arena || slab_lookup(chunk, ptrs[i]) != NULL) {
+			if(Mem_Free(ptrs[i++]) != 0) {
+				result = -1;
+			}
+			continue;
+		}
+		size_t first = i;
+		run = check_free(chunk, ptrs[i++]);
+		if(run == NULL) {
+			result = -1;
+			continue;
+		}
+
+		//extend the run while the next pointer is the payload of the block right after it
+		size_t size = block_size(run);
+		size_t count = 1;
+		while(i < n && (char*)ptrs[i] == (char*)run + size + HEADER_SIZE && check_free(chunk, ptrs[i]) != NULL) {
+			size += block_size((block_tag*)ptrs[i++] - 1);
+			count++;
+		}
+
+		arena_lock(&main_arena);
+		//the headers inside the run are no blocks anymore, a second free has to fail on them
+		for(size_t j = first + 1; j < i; j++) {
+			((block_tag*)ptrs[j] - 1)->size_status &= ~BUSY;
+		}
+		run->size_status = size + BUSY + (run->size_status & PREV_BUSY);
+		heap_free(&main_arena, run);
+		main_arena.stats.free_count += count;
+		pthread_mutex_unlock(&main_arena.lock);
+
+		while(first < i) {
+			trace_event(MEM_TRACE_FREE, ptrs[first++], NULL, 0);
+		}
+	}
+#endif
+	return result;
+}
+
+/*
+ * Changes the size of the block at 'ptr', which is neither NULL nor asked to shrink to 0 bytes
+ * Returns the address of the payload on success and NULL on failure
+ */
+static void *realloc_main(void *ptr, size_t size){
+	mem_chunk *chunk;
+	mem_arena *arena;
+	size_t room;
+	void *newPtr;
+
+	arena = find_arena(ptr, &chunk);
+	if(arena == NULL) {
+		room = 0;
+		newPtr = huge_resize(ptr, size, &room);
+		if(newPtr != NULL || room == 0) {
+			return newPtr;
+		}
+		//a huge block that is to become small moves into the heap
+		newPtr = alloc_main(size);
+		if(newPtr == NULL) {
+			return NULL;
+		}
+		memcpy(newPtr, ptr, room < size ? room : size);
+		huge_free(ptr);
+		return newPtr;
+	}
+
+	mem_slab *slab = arena == &main_arena ? slab_lookup(chunk, ptr) : NULL;
+	if(slab != NULL) {
+		if(!slab_is_slot(slab, ptr)) {
+			return NULL;
+		}
+		room = slab->slot_size;
+		if(size <= room) {
+			return ptr;
+		}
+	}
+	else {
+		block_tag *block = check_free(chunk, ptr);
+		size_t blockSize = round_size(arena, size);
+
+		if(block == NULL) {
+			return NULL;
+		}
+
+		//a block that is to become huge moves out of the heap
+		if(arena != &main_arena || !huge_wanted(size)) {
+			int resized;
+
+			if(blockSize == 0) {
+				return NULL;
+			}
+			arena_lock(arena);
+			resized = heap_resize(arena, block, blockSize);
+			pthread_mutex_unlock(&arena->lock);
+			if(resized == 0) {
+				return ptr;
+			}
+		}
+		room = block_size(block) - HEADER_SIZE - CANARY_SIZE;
+	}
+
+	//moving is the last resort
+	newPtr = arena == &main_arena ? alloc_main(size) : Mem_ArenaAlloc(arena, size);
+	if(newPtr == NULL) {
+		return NULL;
+	}
+	memcpy(newPtr, ptr, room < size ? room : size);
+	free_main(ptr);
+	return newPtr;
+}
+
+/*
+ * Function for changing the size of a previously allocated block to 'size' bytes
+ * Returns the address of the payload, which holds the old contents up to the
+ * smaller of the two sizes, on success
+ * Returns NULL on failure, the old block is then left as it was
+ * - If ptr is NULL - Same as Mem_Alloc
+ * - If size is 0 - Same as Mem_Free, returns NULL
+ * - A block is shrunk in place by splitting off its tail as a free block, and
+ *   grown in place by absorbing the next block if that block is free and big enough
+ * - Only if that is not possible, a new block is allocated from the same arena,
+ *   the contents are copied and the old block is freed
+ * Slab slots stay in place as long as the new size fits into the slot
+ * Huge blocks are resized with mremap as long as they stay above the huge threshold
+ * The call is recorded if a trace is running
+ */
+void* Mem_Realloc(void *ptr, size_t size){
+	void *newPtr;
+
+	if(ptr == NULL) {
+		return Mem_Alloc(size);
+	}
+	if(size == 0) {
+		Mem_Free(ptr);
+		return NULL;
+	}
+
+	newPtr = realloc_main(ptr, size);
+	if(newPtr != NULL) {
+		trace_event(MEM_TRACE_REALLOC, newPtr, ptr, size);
+	}
+	return newPtr;
+}
+
+/*
+ * Function for finding out how many bytes can be used at 'ptr', at least as
+ * many as it was allocated or last resized with
+ * Returns 0 if 'ptr' is NULL or no allocation of the heap, its arenas or
+ * the huge blocks
+ */
+size_t Mem_UsableSize(void *ptr){
+	mem_chunk *chunk;
+	mem_arena *arena;
+	block_tag *block;
+	size_t room = 0;
+
+	if(ptr == NULL) {
+		return 0;
+	}
+	arena = find_arena(ptr, &chunk);
+	if(arena == NULL) {
+		pthread_mutex_lock(&huge.lock);
+		huge_block *hugeBlock = huge_find(ptr);
+		if(hugeBlock != NULL) {
+			room = hugeBlock->map_size - hugeBlock->offset;
+		}
+		pthread_mutex_unlock(&huge.lock);
+		return room;
+	}
+
+	mem_slab *slab = arena == &main_arena ? slab_lookup(chunk, ptr) : NULL;
+	if(slab != NULL) {
+		return slab_is_slot(slab, ptr) ? slab->slot_size : 0;
+	}
+	block = check_free(chunk, ptr);
+	return block == NULL ? 0 : block_size(block) - HEADER_SIZE - CANARY_SIZE;
+}
+
+/*
+ * Scratch arenas
+ * Memory that is given up all at once is handed out by bumping a pointer
+ * through pieces of MEM_SCRATCH_SIZE bytes or more taken from the main heap
+ * Mem_ScratchRewind gives up everything allocated after a mark at once and
+ * the pieces it no longer needs go back to the main heap, so the blocks of the
+ * main heap only see one allocation and one free per piece
+ * The scratch arena sits at the start of its first piece
+ * A scratch arena is used by one thread at a time
+ */
+#define MEM_SCRATCH_SIZE (64 * 1024)
+
+/* Start of every piece after the first, the memory handed out follows */
+typedef struct scratch_piece{
+
+  struct scratch_piece *prev;     /* the piece used before, NULL for the first one */
+  char *end;
+
+} scratch_piece;
+
+struct mem_scratch{
+
+  scratch_piece *piece;           /* the piece in use, NULL while it is the first one */
+  char *next;                     /* where the next allocation is carved from */
+  char *end;                      /* end of the piece in use */
+  char *first_end;                /* end of the first piece */
+  size_t piece_size;              /* size of the pieces taken from the main heap */
+
+};
+
+#define SCRATCH_HEADER_SIZE ALIGN_UP(sizeof(mem_scratch), MEM_ALIGN)
+#define PIECE_HEADER_SIZE ALIGN_UP(sizeof(scratch_piece), MEM_ALIGN)
+
+/*
+ * Function used to create a scratch arena taking pieces of 'pieceSize' bytes,
+ * MEM_SCRATCH_SIZE if it is 0, from the main heap
+ * Returns the scratch arena on success and NULL on failure
+ */
+mem_scratch* Mem_ScratchBegin(size_t pieceSize){
+	mem_scratch *scratch;
+
+	if(pieceSize == 0) {
+		pieceSize = MEM_SCRATCH_SIZE;
+	}
+	if(pieceSize < SCRATCH_HEADER_SIZE + PIECE_HEADER_SIZE) {
+		pieceSize = SCRATCH_HEADER_SIZE + PIECE_HEADER_SIZE;
+	}
+	scratch = alloc_main(pieceSize);
+	if(scratch == NULL) {
+		return NULL;
+	}
+	scratch->piece = NULL;
+	scratch->next = (char*)scratch + SCRATCH_HEADER_SIZE;
+	scratch->end = (char*)scratch + (pieceSize & ~(MEM_ALIGN - 1));
+	scratch->first_end = scratch->end;
+	scratch->piece_size = pieceSize;
+	return scratch;
+}
+
+/*
+ * Takes a new piece with room for 'size' bytes (a multiple of MEM_ALIGN) from the
+ * main heap and carves the allocation from it
+ * Returns the allocation on success and NULL on failure
+ */
+static void *scratch_grow(mem_scratch *scratch, size_t size){
+	size_t pieceSize = scratch->piece_size;
+	scratch_piece *piece;
+
+	if(size > MAX_BLOCK_SIZE - PIECE_HEADER_SIZE) {
+		return NULL;
+	}
+	if(pieceSize < PIECE_HEADER_SIZE + size) {
+		pieceSize = PIECE_HEADER_SIZE + size;
+	}
+	piece = alloc_main(pieceSize);
+	if(piece == NULL) {
+		return NULL;
+	}
+	piece->prev = scratch->piece;
+	piece->end = (char*)piece + (pieceSize & ~(MEM_ALIGN - 1));
+	scratch->piece = piece;
+	scratch->end = piece->end;
+	scratch->next = (char*)piece + PIECE_HEADER_SIZE + size;
+	return (char*)piece + PIECE_HEADER_SIZE;
+}
+
+/*
+ * Function for allocating 'size' bytes from the scratch arena 'scratch', aligned like Mem_Alloc
+ * The memory is only given up by Mem_ScratchRewind, Mem_ScratchReset and Mem_ScratchEnd
+ * Returns the address of the allocation on success and NULL on failure, also if 'size' is 0
+ */
+void* Mem_ScratchAlloc(mem_scratch *scratch, size_t size){
+	char *ptr = scratch->next;
+
+	if(size == 0 || size > MAX_BLOCK_SIZE) {
+		return NULL;
+	}
+	size = ALIGN_UP(size, MEM_ALIGN);
+	if(size <= (size_t)(scratch->end - ptr)) {
+		scratch->next = ptr + size;
+		return ptr;
+	}
+	return scratch_grow(scratch, size);
+}
+
+/*
+ * Returns a mark of how far 'scratch' has been used, for Mem_ScratchRewind
+ */
+mem_scratch_mark Mem_ScratchMark(mem_scratch *scratch){
+	mem_scratch_mark mark = { scratch->piece, scratch->next };
+
+	return mark;
+}
+
+/*
+ * Gives up everything allocated from 'scratch' since 'mark' was taken
+ * The pieces taken from the main heap since then go back to it
+ * Marks taken after 'mark' are no longer valid
+ */
+void Mem_ScratchRewind(mem_scratch *scratch, mem_scratch_mark mark){
+	while(scratch->piece != mark.piece) {
+		scratch_piece *piece = scratch->piece;
+		scratch->piece = piece->prev;
+		free_main(piece);
+	}
+	scratch->next = mark.next;
+	scratch->end = scratch->piece != NULL ? scratch->piece->end : scratch->first_end;
+}
+
+/*
+ * Gives up everything allocated from 'scratch', only the first piece is kept
+ */
+void Mem_ScratchReset(mem_scratch *scratch){
+	mem_scratch_mark start = { NULL, (char*)scratch + SCRATCH_HEADER_SIZE };
+
+	Mem_ScratchRewind(scratch, start);
+}
+
+/*
+ * Gives everything of 'scratch' back to the main heap, 'scratch' itself included
+ */
+void Mem_ScratchEnd(mem_scratch *scratch){
+	if(scratch == NULL) {
+		return;
+	}
+	Mem_ScratchReset(scratch);
+	free_main(scratch);
+}
+
+/*
+ * Selects how 'arena' picks the free block for an allocation, one of
+ * MEM_BEST_FIT (the default), MEM_FIRST_FIT, MEM_NEXT_FIT and MEM_GOOD_FIT
+ * The thread caches and slabs in front of the main arena are not affected
+ * Returns 0 on success and -1 if 'arena' is NULL or 'policy' is unknown
+ */
+int Mem_ArenaSetPolicy(mem_arena *arena, int policy){
+
+	if(arena == NULL || policy < MEM_BEST_FIT || policy > MEM_GOOD_FIT) {
+		return -1;
+	}
+	arena_lock(arena);
+	arena->policy = policy;
+	pthread_mutex_unlock(&arena->lock);
+	return 0;
+}
+
+/*
+ * Selects the placement policy of the heap set up by Mem_Init
+ * Returns 0 on success and -1 if 'policy' is unknown
+ */
+int Mem_SetPolicy(int policy){
+	int node;
+
+	for(node = 0; node < MEM_MAX_NODES; node++) {
+		if(numa.arenas[node] != NULL && numa.arenas[node] != &main_arena) {
+			Mem_ArenaSetPolicy(numa.arenas[node], policy);
+		}
+	}
+	return Mem_ArenaSetPolicy(&main_arena, policy);
+}
+
+/*
+ * Sets the size from which Mem_Alloc, Mem_AllocAligned and Mem_Realloc give a
+ * request a mapping of its own instead of a block of the heap
+ * 0 keeps every request in the heap, which is the default of Mem_Init,
+ * Mem_InitGrowable starts with MEM_HUGE_THRESHOLD
+ * Huge blocks mapped before keep working with any threshold
+ * Returns 0 on success and -1 if 'threshold' is neither 0 nor at least the page size
+ */
+int Mem_SetHugeThreshold(size_t threshold){
+
+	if(threshold != 0 && (threshold < (size_t)getpagesize() || persist.super != NULL)) {
+		return -1;
+	}
+	__atomic_store_n(&huge.threshold, threshold, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * Gives the pages inside the free blocks of 'arena' back to the system, see arena_trim
+ * The quick lists are swept first
+ * Returns the number of bytes given back, 0 if 'arena' is NULL
+ */
+size_t Mem_ArenaTrim(mem_arena *arena){
+	size_t released;
+
+	if(arena == NULL) {
+		return 0;
+	}
+	arena_lock(arena);
+	arena_sweep(arena);
+	released = arena_trim(arena);
+	pthread_mutex_unlock(&arena->lock);
+	return released;
+}
+
+/*
+ * Gives the pages inside the free blocks of the heap set up by Mem_Init back to the system
+ * The objects in the cache of the calling thread are freed first so they can coalesce
+ * Returns the number of bytes given back
+ */
+size_t Mem_Trim(void){
+	size_t released = 0;
+	int node;
+
+	if(thread_cache.registered) {
+		tcache_release(&thread_cache);
+	}
+	for(node = 0; node < MEM_MAX_NODES; node++) {
+		if(numa.arenas[node] != NULL && numa.arenas[node] != &main_arena) {
+			released += Mem_ArenaTrim(numa.arenas[node]);
+		}
+	}
+	return released + Mem_ArenaTrim(&main_arena);
+}
+
+/*
+ * Makes 'arena' trim itself whenever another 'threshold' bytes have been freed
+ * since the last trim, 0 (the default) leaves trimming to Mem_ArenaTrim
+ * Returns 0 on success and -1 if 'arena' is NULL
+ */
+int Mem_ArenaSetTrimThreshold(mem_arena *arena, size_t threshold){
+
+	if(arena == NULL) {
+		return -1;
+	}
+	arena_lock(arena);
+	arena->trim_threshold = threshold;
+	arena->trim_pending = 0;
+	pthread_mutex_unlock(&arena->lock);
+	return 0;
+}
+
+/*
+ * Same as Mem_ArenaSetTrimThreshold for the heap set up by Mem_Init
+ */
+int Mem_SetTrimThreshold(size_t threshold){
+	int node;
+
+	for(node = 0; node < MEM_MAX_NODES; node++) {
+		if(numa.arenas[node] != NULL && numa.arenas[node] != &main_arena) {
+			Mem_ArenaSetTrimThreshold(numa.arenas[node], threshold);
+		}
+	}
+	return Mem_ArenaSetTrimThreshold(&main_arena, threshold);
+}
+
+/*
+ * Makes 'arena' defer coalescing, see heap_release - freed blocks of at most
+ * 1024 bytes wait on quick lists until they add up to 'threshold' bytes or an
+ * allocation finds no free block, 0 (the default) coalesces every free right away
+ * Hardened builds always coalesce right away
+ * Returns 0 on success and -1 if 'arena' is NULL
+ */
+int Mem_ArenaSetDeferThreshold(mem_arena *arena, size_t threshold){
+
+	if(arena == NULL) {
+		return -1;
+	}
+	arena_lock(arena);
+	arena->defer_threshold = threshold;
+	arena_sweep(arena);
+	pthread_mutex_unlock(&arena->lock);
+	return 0;
+}
+
+/*
+ * Same as Mem_ArenaSetDeferThreshold for the heap set up by Mem_Init
+ * Small objects are kept in the thread caches either way
+ */
+int Mem_SetDeferThreshold(size_t threshold){
+	int node;
+
+	for(node = 0; node < MEM_MAX_NODES; node++) {
+		if(numa.arenas[node] != NULL && numa.arenas[node] != &main_arena) {
+			Mem_ArenaSetDeferThreshold(numa.arenas[node], threshold);
+		}
+	}
+	return Mem_ArenaSetDeferThreshold(&main_arena, threshold);
+}
+
+/*
+ * Coalesces every block waiting on the quick lists of 'arena'
+ * Returns the number of bytes coalesced, 0 if 'arena' is NULL
+ */
+size_t Mem_ArenaSweep(mem_arena *arena){
+	size_t swept;
+
+	if(arena == NULL) {
+		return 0;
+	}
+	arena_lock(arena);
+	swept = arena_sweep(arena);
+	pthread_mutex_unlock(&arena->lock);
+	return swept;
+}
+
+/*
+ * Same as Mem_ArenaSweep for the heap set up by Mem_Init
+ */
+size_t Mem_Sweep(void){
+	size_t swept = 0;
+	int node;
+
+	for(node = 0; node < MEM_MAX_NODES; node++) {
+		if(numa.arenas[node] != NULL && numa.arenas[node] != &main_arena) {
+			swept += Mem_ArenaSweep(numa.arenas[node]);
+		}
+	}
+	return swept + Mem_ArenaSweep(&main_arena);
+}
+
+/*
+ * Makes the calling thread use the arena of 'node' in a NUMA aware heap
+ * instead of the one of the node it runs on, -1 goes back to following the thread
+ * Returns 0 on success and -1 if the heap is not NUMA aware or 'node' has no arena
+ */
+int Mem_SetThreadNode(int node){
+
+	if(numa.count == 0 || node < -1 || node >= MEM_MAX_NODES || (node >= 0 && numa.arenas[node] == NULL)) {
+		return -1;
+	}
+	thread_node = node;
+	thread_node_fixed = node >= 0;
+	return 0;
+}
+
+/*
+ * Returns the number of NUMA nodes with an arena of their own, 0 if the heap is not NUMA aware
+ */
+int Mem_NumaNodes(void){
+	return numa.count;
+}
+
+/*
+ * Fills in 'stats' with the counters of 'arena'
+ * The lock of the arena is only held to copy the counters and to look up the
+ * largest free block in the last non empty bin, no block list is walked
+ * Allocations and frees served by the thread caches are added once the thread
+ * refills or drains its cache, those of the calling thread are always included
+ * Returns 0 on success and -1 if 'arena' or 'stats' is NULL
+ */
+int Mem_ArenaGetStats(mem_arena *arena, struct mem_stats *stats){
+
+	if(arena == NULL || stats == NULL) {
+		return -1;
 	}
 
-	//we've found a free block for the allocation, save the size before splitting the block
-	int preSplitSize = best_slot->size_status - prev_block_allocated;
-	
-	//this block points to the newly allocated memory
-	block_tag *newBlock = best_slot + header_size;
+	arena_lock(arena);
+	*stats = arena->stats;
+	stats->failed_allocs = __atomic_load_n(&arena->stats.failed_allocs, __ATOMIC_RELAXED);
+	stats->remote_frees = __atomic_load_n(&arena->stats.remote_frees, __ATOMIC_RELAXED);
+	stats->bytes_busy = arena->total_mem_size - arena->stats.bytes_free;
+	stats->largest_free = largest_free_block(arena);
+	pthread_mutex_unlock(&arena->lock);
 
-	//store the size in the header
-	newBlock->size_status = size + is_busy + prev_block_allocated;
-	(newBlock-header_size)->size_status = newBlock->size_status;
-	
-	//this block points the the extra free memory that is split from the allocation
-	block_tag *splitBlock = best_slot + (size/4);
-	splitBlock->size_status = (preSplitSize - size) + prev_block_allocated;
+	if(arena == &main_arena) {
+		stats->alloc_count += thread_cache.allocs;
+		stats->free_count += thread_cache.frees;
 
-	//setting up the footer for the split block
-	block_tag *footer = splitBlock + (splitBlock->size_status - 2)/4 - prev_block_allocated/4 - 1;
- 	footer->size_status = (preSplitSize - size) + prev_block_allocated;
-	
-	return newBlock;
+		pthread_mutex_lock(&huge.lock);
+		stats->alloc_count += huge.alloc_count;
+		stats->free_count += huge.free_count;
+		stats->huge_bytes = huge.bytes;
+		pthread_mutex_unlock(&huge.lock);
+	}
+	return 0;
 }
 
 /*
- * Function for freeing up a previously allocated block 
- * Argument - ptr: Address of the payload of the allocated block to be freed up 
- * Returns 0 on success 
- * Returns -1 on failure 
- * Here is what this function should accomplish 
- * - Return -1 if ptr is NULL
- * - Return -1 if ptr is not within the range of memory allocated by Mem_Init()
- * - Return -1 if ptr is not 4 byte aligned
- * - Mark the block as free 
- * - Coalesce if one or both of the immediate neighbours are free 
+ * Fills in 'stats' with the counters of the heap set up by Mem_Init, summed
+ * up over the arenas of all nodes in a NUMA aware heap
+ * Returns 0 on success and -1 if 'stats' is NULL
  */
-int Mem_Free(void *ptr){
+int Mem_GetStats(struct mem_stats *stats){
+	struct mem_stats other;
+	int node;
+	int i;
 
-	//Return -1 if ptr is NULL	
-	if(ptr == NULL) {
+	if(Mem_ArenaGetStats(&main_arena, stats) != 0) {
 		return -1;
 	}
+	for(node = 0; node < MEM_MAX_NODES; node++) {
+		if(numa.arenas[node] == NULL || numa.arenas[node] == &main_arena) {
+			continue;
+		}
+		Mem_ArenaGetStats(numa.arenas[node], &other);
+		stats->bytes_busy += other.bytes_busy;
+		stats->bytes_free += other.bytes_free;
+		if(other.largest_free > stats->largest_free) {
+			stats->largest_free = other.largest_free;
+		}
+		stats->alloc_count += other.alloc_count;
+		stats->free_count += other.free_count;
+		stats->failed_allocs += other.failed_allocs;
+		for(i = 0; i < MEM_STATS_VISIT_BUCKETS; i++) {
+			stats->visits[i] += other.visits[i];
+		}
+		stats->trim_count += other.trim_count;
+		stats->bytes_trimmed += other.bytes_trimmed;
+		stats->remote_frees += other.remote_frees;
+		stats->sweep_count += other.sweep_count;
+	}
+	return 0;
+}
+
+/*
+ * Starts recording every allocation, reallocation and free made through
+ * Mem_Alloc, Mem_AllocAligned, Mem_AllocBatch, Mem_Realloc, Mem_Free and
+ * Mem_FreeBatch by any thread into the file at 'path', see mem.h for the format
+ * The file is created or truncated and sized for 'maxEvents' events up front,
+ * events which do not fit are counted in the header and dropped
+ * Returns 0 on success and -1 on failure or if a trace is already running
+ */
+int Mem_TraceStart(const char *path, size_t maxEvents){
+	struct mem_trace_header *header;
+	size_t size;
+	void *map;
+	int fd;
 
-	//Return -1 if ptr is not within the range of memory allocated by Mem_Init()
- 	if((int)ptr < (int)first_block || (int)ptr > (int)first_block + total_mem_size) {
+	if(path == NULL || maxEvents == 0 || maxEvents > (SIZE_MAX - sizeof(*header)) / sizeof(struct mem_trace_event)) {
 		return -1;
 	}
+	size = sizeof(*header) + maxEvents * sizeof(struct mem_trace_event);
 
-	//Return -1 if ptr is not 4 byte aligned
-	if((int)ptr % 4 != 0) {
+	pthread_rwlock_wrlock(&trace.lock);
+	if(trace.map != NULL) {
+		pthread_rwlock_unlock(&trace.lock);
+		return -1;
+	}
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1) {
+		pthread_rwlock_unlock(&trace.lock);
+		fprintf(stderr,"Error:mem.c: Cannot open trace file %s\n", path);
+		return -1;
+	}
+	map = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if(map == MAP_FAILED) {
+		close(fd);
+		pthread_rwlock_unlock(&trace.lock);
+		fprintf(stderr,"Error:mem.c: Cannot map trace file %s\n", path);
 		return -1;
 	}
 
-	//This points the block that the user wants to free
-	block_tag *blockToFree = (block_tag *)ptr;
+	header = map;
+	memcpy(header->magic, MEM_TRACE_MAGIC, sizeof(header->magic));
+	header->version = MEM_TRACE_VERSION;
+	header->event_size = sizeof(struct mem_trace_event);
+	header->dropped = 0;
 
-	//This points to the header of the block the user wants to free 
-	block_tag *coalescedBlock = blockToFree - 4;
-
-	//mark as free
-	coalescedBlock->size_status = coalescedBlock->size_status - 1;
-	
-	//If next block is busy and previous block is also busy
-	if((coalescedBlock + (coalescedBlock->size_status - 2)/4)->size_status & 1 && coalescedBlock->size_status % 4 != 0){		
-		
-		//Add a footer that holds the size_status		
-		(coalescedBlock + (coalescedBlock->size_status - 2)/4 - 4)->size_status = coalescedBlock->size_status;
-
-		//By freeing this block, the next block's previous block is no longer busy, so subtract 2 from he next blocks size_status		
-		(coalescedBlock + (coalescedBlock->size_status - 2)/4)->size_status -= 2;
-	}
-	
-	//If next block is busy and previous block is free
-	else if((coalescedBlock + (coalescedBlock->size_status)/4)->size_status & 1 && coalescedBlock->size_status % 4 == 0) {
-
-		//Add a footer an set its size_status to the current block + the next block
-		block_tag *footer = coalescedBlock + (coalescedBlock->size_status)/4 - 1;
-		footer->size_status = coalescedBlock->size_status + (coalescedBlock - 4)->size_status;
-
-		//Move the current block's header to the previous block's header and update the size_status
-		coalescedBlock = coalescedBlock - ((coalescedBlock - 4)->size_status)/4;
-		coalescedBlock->size_status = footer->size_status;
-
-		//By freeing this block, the next block's previous block is no longer busy, so subtract 2 from he next blocks size_status
-		(footer + 1)->size_status -= 2;
-	}
-
-	//If the next block is free but the previous block is busy
-	else if(((coalescedBlock + (coalescedBlock->size_status - 2)/4)->size_status) % 2 == 0 && coalescedBlock->size_status % 4 != 0) {
-
-		//Update the header size_status to be the current block's size status + the previous block's size_status
-		coalescedBlock->size_status = coalescedBlock->size_status + (coalescedBlock + (coalescedBlock->size_status - 2)/4)->size_status - 2;
-
-		//Update the size_status of the footer
-		(coalescedBlock + (coalescedBlock->size_status - 2)/4 - 4)->size_status = coalescedBlock->size_status;			
-	}
-	
-	//If next block is free and previous block is also free
-	else if(((coalescedBlock + (coalescedBlock->size_status)/4)->size_status) % 2 == 0 && coalescedBlock->size_status % 4 == 0) {		
-		
-		//We need to coalesce on both sides, so create temp variables to hold the current size_status and next size_status
-		int temp = coalescedBlock->size_status;
-		
-		coalescedBlock->size_status = (coalescedBlock + (coalescedBlock->size_status)/4)->size_status - 2;
-		
-		//Create a footer
-		block_tag *footer = (coalescedBlock + (coalescedBlock->size_status)/4 - 4);
-	
-		int temp2 = coalescedBlock->size_status;	
-
-		//Move the pointer to he header of the previous block and update the size_status of the header and footer
-		coalescedBlock = coalescedBlock - ((coalescedBlock - 4)->size_status - 2)/4;
-		coalescedBlock->size_status = coalescedBlock->size_status + temp + temp2;
-		footer->size_status = coalescedBlock->size_status;
+	trace.map = map;
+	trace.capacity = size;
+	trace.used = sizeof(*header);
+	trace.dropped = 0;
+	trace.threads = 0;
+	trace.fd = fd;
+	__atomic_add_fetch(&trace.generation, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&trace.enabled, 1, __ATOMIC_RELEASE);
+	pthread_rwlock_unlock(&trace.lock);
+	return 0;
+}
+
+/*
+ * Stops the trace started by Mem_TraceStart and closes the file, which is cut
+ * down to the events written
+ * The events still buffered by any thread are written first, events recorded
+ * while the trace stops are either written or not recorded at all
+ * Returns 0 on success and -1 if no trace is running
+ */
+int Mem_TraceStop(void){
+	struct mem_trace_header *header;
+	trace_buffer *buffer;
+	size_t used;
+
+	__atomic_store_n(&trace.enabled, 0, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&trace.buffers_lock);
+	//threads in the middle of an event finish it, no new one starts
+	for(buffer = trace.buffers; buffer != NULL; buffer = buffer->next) {
+		while(__atomic_load_n(&buffer->busy, __ATOMIC_ACQUIRE)) {
+			sched_yield();
 		}
-	//Returns 0 on success
+	}
+
+	pthread_rwlock_wrlock(&trace.lock);
+	if(trace.map == NULL) {
+		pthread_rwlock_unlock(&trace.lock);
+		pthread_mutex_unlock(&trace.buffers_lock);
+		return -1;
+	}
+	for(buffer = trace.buffers; buffer != NULL; buffer = buffer->next) {
+		if(buffer->count != 0) {
+			trace_copy(buffer);
+		}
+	}
+	pthread_mutex_unlock(&trace.buffers_lock);
+	used = trace.used < trace.capacity ? trace.used : trace.capacity;
+	header = (struct mem_trace_header*)trace.map;
+	header->dropped = trace.dropped;
+	munmap(trace.map, trace.capacity);
+	if(ftruncate(trace.fd, used) != 0) {
+		fprintf(stderr,"Error:mem.c: Cannot truncate the trace file\n");
+	}
+	close(trace.fd);
+	trace.map = NULL;
+	pthread_rwlock_unlock(&trace.lock);
 	return 0;
 }
 
 /*
- * Function used to initialize the memory allocator
+ * Maps a region of at least 'sizeOfRegion' bytes with the MEM_INIT_* options in 'flags',
+ * placed on 'node' unless it is -1, and sets up an arena in it
+ * Returns the new arena on success and NULL on failure
+ * The arena structure itself is kept at the start of its region
+ */
+static mem_arena *arena_create(size_t sizeOfRegion, int flags, int node){
+  size_t alloc_size;
+  void* space_ptr;
+  mem_arena *arena;
+
+  alloc_size = ALIGN_UP(sizeOfRegion + sizeof(mem_arena), heap_page_size(flags));
+
+  space_ptr = map_heap(alloc_size, flags, node);
+  if (NULL == space_ptr){
+    return NULL;
+  }
+
+  arena = (mem_arena*) space_ptr;
+  pthread_mutex_init(&arena->lock, NULL);
+
+  if(-1 == arena_init(arena, (char*)space_ptr + sizeof(mem_arena), alloc_size - sizeof(mem_arena), flags & MEM_INIT_GROWABLE)){
+    pthread_mutex_destroy(&arena->lock);
+    munmap(space_ptr, alloc_size);
+    return NULL;
+  }
+  arena->map_flags = flags;
+  arena->node = node;
+  return arena;
+}
+
+/* Set once the main arena is set up, by init_main_arena or Mem_InitFile */
+static int allocated_once = 0;
+
+/*
+ * Sets up the main arena with a region of at least 'sizeOfRegion' bytes
+ * mapped with the MEM_INIT_* options in 'flags'
  * Not intended to be called more than once by a program
- * Argument - sizeOfRegion: Specifies the size of the chunk which needs to be allocated
  * Returns 0 on success and -1 on failure 
  */
-int Mem_Init(int sizeOfRegion){
-  int pagesize;
-  int padsize;
-  int fd;
-  int alloc_size;
+static int init_main_arena(size_t sizeOfRegion, int flags){
+  size_t alloc_size;
   void* space_ptr;
-  static int allocated_once = 0;
+  int hugepages;
+  int nodes[MEM_MAX_NODES];
+  int count = 0;
+  int node = -1;
+  int i;
   
   if(0 != allocated_once){
     fprintf(stderr,"Error:mem.c: Mem_Init has allocated space during a previous call\n");
     return -1;
   }
-  if(sizeOfRegion <= 0){
+  if(sizeOfRegion == 0){
     fprintf(stderr,"Error:mem.c: Requested block size is not positive\n");
     return -1;
   }
+  // At most one kind of hugepages
+  hugepages = !!(flags & MEM_INIT_HUGETLB_2MB) + !!(flags & MEM_INIT_HUGETLB_1GB) + !!(flags & MEM_INIT_THP);
+  if((flags & ~MEM_INIT_FLAGS) || hugepages > 1){
+    fprintf(stderr,"Error:mem.c: Unknown or conflicting options\n");
+    return -1;
+  }
 
-  // Get the pagesize
-  pagesize = getpagesize();
-
-  // Calculate padsize as the padding required to round up sizeOfRegion to a multiple of pagesize
-  padsize = sizeOfRegion % pagesize;
-  padsize = (pagesize - padsize) % pagesize;
+  alloc_size = ALIGN_UP(sizeOfRegion, heap_page_size(flags));
 
-  alloc_size = sizeOfRegion + padsize;
+  // The main arena serves the first node
+  if(flags & MEM_INIT_NUMA){
+    count = numa_online(nodes);
+    node = nodes[0];
+  }
 
-  // Using mmap to allocate memory
-  fd = open("/dev/zero", O_RDWR);
-  if(-1 == fd){
-    fprintf(stderr,"Error:mem.c: Cannot open /dev/zero\n");
+  space_ptr = map_heap(alloc_size, flags, node);
+  if (NULL == space_ptr){
+    allocated_once = 0;
     return -1;
   }
-  space_ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-  if (MAP_FAILED == space_ptr){
-    fprintf(stderr,"Error:mem.c: mmap cannot allocate space\n");
+  
+  allocated_once = 1;
+
+  main_arena.map_flags = flags;
+  if(-1 == arena_init(&main_arena, space_ptr, alloc_size, flags & MEM_INIT_GROWABLE)){
+    munmap(space_ptr, alloc_size);
     allocated_once = 0;
     return -1;
   }
+  main_arena.node = node;
+  if(flags & MEM_INIT_GROWABLE){
+    huge.threshold = MEM_HUGE_THRESHOLD;
+  }
+
+  // Nodes the arena cannot be set up for are served by the main arena
+  if(flags & MEM_INIT_NUMA){
+    numa.arenas[node] = &main_arena;
+    for(i = 1; i < count; i++){
+      numa.arenas[nodes[i]] = arena_create(sizeOfRegion, flags, nodes[i]);
+    }
+    numa.count = count;
+  }
   
+  return 0;
+}
+
+/*
+ * Function used to initialize the memory allocator
+ * Not intended to be called more than once by a program
+ * Argument - sizeOfRegion: Specifies the size of the chunk which needs to be allocated
+ * Returns 0 on success and -1 on failure 
+ */
+int Mem_Init(size_t sizeOfRegion){
+  return init_main_arena(sizeOfRegion, 0);
+}
+
+/*
+ * Function used to initialize the memory allocator with a growable heap
+ * Same as Mem_Init, but when no free block fits Mem_Alloc maps an additional
+ * chunk instead of failing, and chunks at the end which become completely
+ * free are unmapped again
+ * Requests of MEM_HUGE_THRESHOLD bytes or more get a mapping of their own
+ * Argument - sizeOfRegion: Specifies the size of the first chunk
+ * Returns 0 on success and -1 on failure 
+ */
+int Mem_InitGrowable(size_t sizeOfRegion){
+  return init_main_arena(sizeOfRegion, MEM_INIT_GROWABLE);
+}
+
+/*
+ * Function used to initialize the memory allocator with the options in 'flags',
+ * any combination of the MEM_INIT_* values except for two kinds of hugepages at once
+ * Mem_InitEx(size, 0) is Mem_Init and Mem_InitEx(size, MEM_INIT_GROWABLE) is Mem_InitGrowable
+ * With hugepages the region is rounded up to the hugepage size, and so are the
+ * chunks a growable heap adds, which are mapped with the same options
+ * Returns 0 on success and -1 on failure, also if the system has no hugepages
+ * to spare or does not allow locking that much memory
+ */
+int Mem_InitEx(size_t sizeOfRegion, int flags){
+  return init_main_arena(sizeOfRegion, flags);
+}
+
+/*
+ * Copies the state of the main arena into the superblock and writes the file out
+ * The heap can be reopened from the file until it changes again
+ * Returns 0 on success and -1 if there is no persistent heap or writing fails
+ */
+int Mem_SyncFile(void){
+  int result;
+
+  if(NULL == persist.super){
+    return -1;
+  }
+  arena_lock(&main_arena);
+  persist.super->arena = main_arena;
+  persist.super->clean = 1;
+  result = msync(persist.super, persist.super->size, MS_SYNC);
+  pthread_mutex_unlock(&main_arena.lock);
+  return result == 0 ? 0 : -1;
+}
+
+/*
+ * Syncs the persistent heap when the program exits
+ */
+static void file_exit(void){
+  Mem_SyncFile();
+}
+
+/*
+ * Checks the superblock of 'super', which describes a file of 'size' bytes, before it is mapped
+ * Returns 0 if the heap can be reopened and -1 otherwise
+ */
+static int file_check(const file_super *super, size_t size){
+  uintptr_t first = (uintptr_t)super->arena.first_chunk.first_block;
+
+  if(0 != memcmp(super->magic, MEM_FILE_MAGIC, sizeof(super->magic)) || MEM_FILE_VERSION != super->version){
+    fprintf(stderr,"Error:mem.c: Not a heap file\n");
+    return -1;
+  }
+  if(MEM_FILE_LAYOUT != super->layout || sizeof(mem_arena) != super->arena_size || size != super->size){
+    fprintf(stderr,"Error:mem.c: Heap file does not match this build\n");
+    return -1;
+  }
+  if(first < super->base + sizeof(file_super) || super->arena.first_chunk.size > super->base + size - first){
+    fprintf(stderr,"Error:mem.c: Heap file is damaged\n");
+    return -1;
+  }
+  if(!super->clean){
+    fprintf(stderr,"Error:mem.c: Heap file was not synced after its last change\n");
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Maps the heap file 'fd' of 'size' bytes, at 'base' unless it is NULL
+ * Returns the address of the mapping on success and NULL on failure
+ */
+static file_super *map_file(int fd, size_t size, void *base){
+  void* space_ptr;
+
+  space_ptr = mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | (base != NULL ? MAP_FIXED_NOREPLACE : 0), fd, 0);
+  if(MAP_FAILED == space_ptr){
+    fprintf(stderr,"Error:mem.c: mmap cannot map the heap file\n");
+    return NULL;
+  }
+  // Kernels without MAP_FIXED_NOREPLACE take the address as a hint
+  if(base != NULL && space_ptr != base){
+    munmap(space_ptr, size);
+    fprintf(stderr,"Error:mem.c: The address of the heap file is taken\n");
+    return NULL;
+  }
+  return space_ptr;
+}
+
+/*
+ * Function used to initialize the memory allocator with a heap kept in the file at 'path'
+ * A new or empty file is set up with a heap of at least 'sizeOfRegion' bytes,
+ * an existing one is reopened as it was left by the last Mem_SyncFile, and
+ * 'sizeOfRegion' must be 0 or fit into it
+ * The heap is synced when the program exits, Mem_SyncFile syncs it before
+ * The heap cannot grow, and small sizes are not served from thread caches
+ * Not intended to be called more than once by a program, or together with Mem_Init
+ * Returns 0 on success and -1 on failure, also if the file is no heap file, was
+ * created by a different build, was not synced after its last change or cannot
+ * be mapped at its address again
+ */
+int Mem_InitFile(const char *path, size_t sizeOfRegion){
+  size_t header = round_to_pages(sizeof(file_super));
+  size_t alloc_size;
+  file_super *super;
+  file_super saved;
+  struct stat st;
+  int fd;
+
+  if(0 != allocated_once){
+    fprintf(stderr,"Error:mem.c: Mem_Init has allocated space during a previous call\n");
+    return -1;
+  }
+  fd = open(path, O_RDWR | O_CREAT, 0600);
+  if(-1 == fd){
+    fprintf(stderr,"Error:mem.c: Cannot open the heap file\n");
+    return -1;
+  }
+  if(-1 == fstat(fd, &st)){
+    close(fd);
+    return -1;
+  }
+
+  if(0 == st.st_size){
+    if(sizeOfRegion == 0){
+      fprintf(stderr,"Error:mem.c: Requested block size is not positive\n");
+      close(fd);
+      return -1;
+    }
+    alloc_size = header + round_to_pages(sizeOfRegion);
+    if(-1 == ftruncate(fd, alloc_size)){
+      fprintf(stderr,"Error:mem.c: Cannot size the heap file\n");
+      close(fd);
+      return -1;
+    }
+    super = map_file(fd, alloc_size, NULL);
+    if(NULL == super){
+      close(fd);
+      return -1;
+    }
+    if(-1 == arena_init(&main_arena, (char*)super + header, alloc_size - header, 0)){
+      munmap(super, alloc_size);
+      close(fd);
+      return -1;
+    }
+    main_arena.map_flags = MEM_MAP_SHARED;
+    memcpy(super->magic, MEM_FILE_MAGIC, sizeof(super->magic));
+    super->version = MEM_FILE_VERSION;
+    super->layout = MEM_FILE_LAYOUT;
+    super->arena_size = sizeof(mem_arena);
+    super->base = (uintptr_t)super;
+    super->size = alloc_size;
+  }
+  else{
+    // Only the superblock is read, the heap is taken as it is
+    alloc_size = st.st_size;
+    if(sizeof(saved) != pread(fd, &saved, sizeof(saved), 0) || -1 == file_check(&saved, alloc_size)){
+      close(fd);
+      return -1;
+    }
+    if(sizeOfRegion > saved.arena.total_mem_size){
+      fprintf(stderr,"Error:mem.c: Requested block size is bigger than the heap file\n");
+      close(fd);
+      return -1;
+    }
+    super = map_file(fd, alloc_size, (void*)(uintptr_t)saved.base);
+    if(NULL == super){
+      close(fd);
+      return -1;
+    }
+
+    // Everything outside of the file is set up anew
+    main_arena = super->arena;
+    pthread_mutex_init(&main_arena.lock, NULL);
+    main_arena.first_chunk.next = NULL;
+    main_arena.first_chunk.prev = NULL;
+    main_arena.first_chunk.slab_map = NULL;
+    main_arena.last_chunk = &main_arena.first_chunk;
+    main_arena.remote_frees = NULL;
+    if(-1 == region_add(&main_arena, &main_arena.first_chunk)){
+      munmap(super, alloc_size);
+      close(fd);
+      return -1;
+    }
+  }
+
+  // The mapping keeps the file open
+  close(fd);
   allocated_once = 1;
-  
-  // Intialising total available memory size
-  total_mem_size = alloc_size;
+  persist.super = super;
+  atexit(file_exit);
+  return Mem_SyncFile();
+}
 
-  // To begin with there is only one big free block
-  first_block = (block_tag*) space_ptr;
-  
-  // Setting up the header
-  first_block->size_status = alloc_size;
-  // Marking the previous block as busy
-  first_block->size_status += 2;
+/*
+ * Stores 'ptr', which must be NULL or point into the heap, in the superblock of
+ * the persistent heap, to be found again with Mem_GetFileRoot after reopening
+ * Returns 0 on success and -1 if there is no persistent heap or 'ptr' is outside of it
+ */
+int Mem_SetFileRoot(void *ptr){
+  mem_chunk *chunk;
 
-  // Setting up the footer
-  block_tag *footer = (block_tag*)((char*)first_block + alloc_size - 4);
-  footer->size_status = alloc_size;
-  
+  if(NULL == persist.super || (ptr != NULL && find_arena(ptr, &chunk) != &main_arena)){
+    return -1;
+  }
+  persist.super->root = (uintptr_t)ptr;
+  return 0;
+}
+
+/*
+ * Returns the pointer last stored with Mem_SetFileRoot, NULL if there is none or no persistent heap
+ */
+void* Mem_GetFileRoot(void){
+  return persist.super != NULL ? (void*)(uintptr_t)persist.super->root : NULL;
+}
+
+/*
+ * Function used to create an additional, independent arena
+ * Can be called any number of times, with or without Mem_Init
+ * Argument - sizeOfRegion: Specifies the size of the chunk which needs to be allocated
+ * Returns the new arena on success and NULL on failure
+ */
+mem_arena* Mem_ArenaCreate(size_t sizeOfRegion){
+
+  if(sizeOfRegion == 0){
+    fprintf(stderr,"Error:mem.c: Requested block size is not positive\n");
+    return NULL;
+  }
+  return arena_create(sizeOfRegion, 0, -1);
+}
+
+/*
+ * Shared heaps, set up with Mem_ShmCreate and Mem_ShmAttach
+ * A POSIX shared memory object laid out like a heap file, but with the arena
+ * itself in the superblock instead of a copy, guarded by a process shared lock
+ * Every process maps the object at the address it was created at, so the
+ * pointers of the free lists are the same everywhere - processes pass blocks
+ * to each other as offsets, see Mem_ArenaOffset
+ * The magic is written last, a process attaching before that is turned away
+ */
+
+/*
+ * Function used to create an arena of at least 'sizeOfRegion' bytes in the new
+ * shared memory object 'name', which other processes can attach to
+ * Returns the new arena on success and NULL on failure, also if 'name' exists
+ */
+mem_arena* Mem_ShmCreate(const char *name, size_t sizeOfRegion){
+  size_t header = round_to_pages(sizeof(file_super));
+  size_t alloc_size;
+  pthread_mutexattr_t attr;
+  file_super *super;
+  int fd;
+
+  if(sizeOfRegion == 0){
+    fprintf(stderr,"Error:mem.c: Requested block size is not positive\n");
+    return NULL;
+  }
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(-1 == fd){
+    fprintf(stderr,"Error:mem.c: Cannot create the shared memory object\n");
+    return NULL;
+  }
+  alloc_size = header + round_to_pages(sizeOfRegion);
+  if(-1 == ftruncate(fd, alloc_size) || NULL == (super = map_file(fd, alloc_size, NULL))){
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  close(fd);
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&super->arena.lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if(-1 == arena_init(&super->arena, (char*)super + header, alloc_size - header, 0)){
+    munmap(super, alloc_size);
+    shm_unlink(name);
+    return NULL;
+  }
+  super->arena.map_flags = MEM_MAP_SHARED;
+  super->version = MEM_FILE_VERSION;
+  super->layout = MEM_FILE_LAYOUT;
+  super->arena_size = sizeof(mem_arena);
+  super->base = (uintptr_t)super;
+  super->size = alloc_size;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(super->magic, MEM_SHM_MAGIC, sizeof(MEM_SHM_MAGIC));
+  return &super->arena;
+}
+
+/*
+ * Function used to attach to the arena another process created in the shared memory object 'name'
+ * Returns the arena on success and NULL on failure, also if the arena was created
+ * by a different build or its address is taken in this process
+ */
+mem_arena* Mem_ShmAttach(const char *name){
+  file_super *super;
+  file_super saved;
+  struct stat st;
+  int fd;
+
+  fd = shm_open(name, O_RDWR, 0);
+  if(-1 == fd){
+    fprintf(stderr,"Error:mem.c: Cannot open the shared memory object\n");
+    return NULL;
+  }
+  if(-1 == fstat(fd, &st) || sizeof(saved) != pread(fd, &saved, sizeof(saved), 0)
+     || 0 != memcmp(saved.magic, MEM_SHM_MAGIC, sizeof(MEM_SHM_MAGIC))){
+    fprintf(stderr,"Error:mem.c: Not a shared heap\n");
+    close(fd);
+    return NULL;
+  }
+  if(MEM_FILE_VERSION != saved.version || MEM_FILE_LAYOUT != saved.layout || sizeof(mem_arena) != saved.arena_size
+     || (size_t)st.st_size != saved.size){
+    fprintf(stderr,"Error:mem.c: Shared heap does not match this build\n");
+    close(fd);
+    return NULL;
+  }
+  super = map_file(fd, saved.size, (void*)(uintptr_t)saved.base);
+  close(fd);
+  if(NULL == super){
+    return NULL;
+  }
+  if(-1 == region_add(&super->arena, &super->arena.first_chunk)){
+    munmap(super, saved.size);
+    return NULL;
+  }
+  return &super->arena;
+}
+
+/*
+ * Function used to detach from an arena created by Mem_ShmCreate or Mem_ShmAttach
+ * The arena stays usable by the other processes, shm_unlink removes it once all have detached
+ * Returns 0 on success and -1 if 'arena' is not a shared arena
+ */
+int Mem_ShmDetach(mem_arena *arena){
+  file_super *super;
+
+  if(arena == NULL || arena == &main_arena){
+    return -1;
+  }
+  // The arena of a shared heap is never at the start of a page, the one of Mem_ArenaCreate always is
+  super = (file_super*)((char*)arena - offsetof(file_super, arena));
+  if(0 != (uintptr_t)super % getpagesize()){
+    return -1;
+  }
+  if(0 != memcmp(super->magic, MEM_SHM_MAGIC, sizeof(MEM_SHM_MAGIC))){
+    return -1;
+  }
+  region_remove(&arena->first_chunk);
+  munmap(super, super->size);
   return 0;
 }
 
+/*
+ * Returns the offset of 'ptr' from the first block of 'arena', which stays the
+ * same in every process attached to a shared arena
+ * Returns (size_t)-1 if 'ptr' is not inside the first chunk of 'arena'
+ */
+size_t Mem_ArenaOffset(mem_arena *arena, void *ptr){
+  char *first;
+
+  if(arena == NULL){
+    return (size_t)-1;
+  }
+  first = (char*)arena->first_chunk.first_block;
+  if((char*)ptr < first || (char*)ptr >= first + arena->first_chunk.size){
+    return (size_t)-1;
+  }
+  return (char*)ptr - first;
+}
+
+/*
+ * Returns the address at 'offset' from the first block of 'arena', see Mem_ArenaOffset
+ * Returns NULL if 'offset' is not inside the first chunk of 'arena'
+ */
+void* Mem_ArenaPointer(mem_arena *arena, size_t offset){
+  if(arena == NULL || offset >= arena->first_chunk.size){
+    return NULL;
+  }
+  return (char*)arena->first_chunk.first_block + offset;
+}
+
 /* 
  * Function to be used for debugging 
- * Prints out a list of all the blocks along with the following information for each block 
+ * Prints out a list of all the blocks of the main arena along with the following information for each block 
  * No.      : serial number of the block 
  * Status   : free/busy 
  * Prev     : status of previous block free/busy
  * t_Begin  : address of the first byte in the block (this is where the header starts) 
  * t_End    : address of the last byte in the block 
  * t_Size   : size of the block (as stored in the block header)(including the header/footer)
+ * Blocks held in the thread caches are listed as busy
+ * The overhead size counts the headers of busy blocks, the headers and footers of free blocks and the epilogues
+ * The blocks of all chunks are listed in the order the chunks were added, epilogues are left out
  */ 
 void Mem_Dump() {
   int counter;
@@ -324,20 +4361,32 @@ void Mem_Dump() {
   char p_status[5];
   char *t_begin = NULL;
   char *t_end = NULL;
-  int t_size;
+  size_t t_size;
 
-  block_tag *current = first_block;
+  arena_lock(&main_arena);
+
+  mem_chunk *chunk = &main_arena.first_chunk;
+  block_tag *current = chunk->first_block;
   counter = 1;
 
-  int busy_size = 0;
-  int free_size = 0;
+  size_t busy_size = 0;
+  size_t free_size = 0;
+  size_t overhead_size = 0;
   int is_busy = -1;
 
   fprintf(stdout,"************************************Block list***********************************\n");
   fprintf(stdout,"No.\tStatus\tPrev\tt_Begin\t\tt_End\t\tt_Size\n");
   fprintf(stdout,"---------------------------------------------------------------------------------\n");
   
-  while(current < (block_tag*)((char*)first_block + total_mem_size)){
+  while(chunk != NULL && current != NULL){
+
+    // Continue with the next chunk once the epilogue is reached
+    if(current == (block_tag*)((char*)chunk->first_block + chunk->size - HEADER_SIZE)){
+      overhead_size += HEADER_SIZE;
+      chunk = chunk->next;
+      current = chunk != NULL ? chunk->first_block : NULL;
+      continue;
+    }
 
     t_begin = (char*)current;
     
@@ -363,9 +4412,11 @@ void Mem_Dump() {
     if (is_busy) busy_size += t_size;
     else free_size += t_size;
 
+    overhead_size += is_busy ? HEADER_SIZE : 2 * HEADER_SIZE;
+
     t_end = t_begin + t_size - 1;
     
-    fprintf(stdout,"%d\t%s\t%s\t0x%08lx\t0x%08lx\t%d\n",counter,status,p_status,
+    fprintf(stdout,"%d\t%s\t%s\t0x%08lx\t0x%08lx\t%zu\n",counter,status,p_status,
                     (unsigned long int)t_begin,(unsigned long int)t_end,t_size);
     
     current = (block_tag*)((char*)current + t_size);
@@ -374,10 +4425,110 @@ void Mem_Dump() {
   fprintf(stdout,"---------------------------------------------------------------------------------\n");
   fprintf(stdout,"*********************************************************************************\n");
 
-  fprintf(stdout,"Total busy size = %d\n",busy_size);
-  fprintf(stdout,"Total free size = %d\n",free_size);
-  fprintf(stdout,"Total size = %d\n",busy_size+free_size);
+  fprintf(stdout,"Total busy size = %zu\n",busy_size);
+  fprintf(stdout,"Total free size = %zu\n",free_size);
+  fprintf(stdout,"Total size = %zu\n",busy_size+free_size);
+  fprintf(stdout,"Total overhead size = %zu\n",overhead_size);
   fprintf(stdout,"*********************************************************************************\n");
   fflush(stdout);
+  pthread_mutex_unlock(&main_arena.lock);
   return;
 }
+
+/*
+ * Function to be used for tuning the heap - prints a compact summary instead of one line per block
+ * The heap is walked once without formatting anything per block and the report shows
+ * - The number and total size of free blocks for every power of two size range
+ * - The largest free block and the external fragmentation, the part of the
+ *   free memory which is not in the largest free block
+ * - The number and mapped size of the huge blocks, which are not part of the heap
+ * - A map of the heap with one character per 1/SUMMARY_MAP_WIDTH of its size,
+ *   chunks placed one after the other
+ *   '#' - only busy blocks, '.' - only free blocks, '+' - both
+ */
+#define SUMMARY_MAP_WIDTH 64
+
+void Mem_DumpSummary() {
+  size_t bucket_count[SIZE_BITS] = {0};
+  size_t bucket_size[SIZE_BITS] = {0};
+  size_t map_busy[SUMMARY_MAP_WIDTH] = {0};
+  size_t map_free[SUMMARY_MAP_WIDTH] = {0};
+  char map[SUMMARY_MAP_WIDTH + 1];
+  size_t busy_count = 0;
+  size_t free_count = 0;
+  size_t busy_size = 0;
+  size_t free_size = 0;
+  size_t largest = 0;
+  size_t offset = 0;
+  size_t slice_size;
+  size_t huge_count;
+  size_t huge_bytes;
+  char range[48];
+  int i;
+
+  arena_lock(&main_arena);
+  slice_size = (main_arena.total_mem_size + SUMMARY_MAP_WIDTH - 1) / SUMMARY_MAP_WIDTH;
+
+  for(mem_chunk *chunk = &main_arena.first_chunk; chunk != NULL && slice_size != 0; chunk = chunk->next){
+    block_tag *epilogue = (block_tag*)((char*)chunk->first_block + chunk->size - HEADER_SIZE);
+
+    for(block_tag *current = chunk->first_block; current != epilogue; current = next_block(current)){
+      size_t t_size = block_size(current);
+      int is_busy = current->size_status & BUSY;
+      size_t *slices = is_busy ? map_busy : map_free;
+      size_t end = offset + t_size;
+
+      if(is_busy){
+        busy_count++;
+        busy_size += t_size;
+      }
+      else{
+        free_count++;
+        free_size += t_size;
+        bucket_count[SIZE_BITS - 1 - __builtin_clzl(t_size)]++;
+        bucket_size[SIZE_BITS - 1 - __builtin_clzl(t_size)] += t_size;
+        if(t_size > largest) largest = t_size;
+      }
+
+      // Spread the block over the map slices it covers
+      while(offset < end){
+        size_t slice = offset / slice_size;
+        size_t slice_end = (slice + 1) * slice_size;
+        if(slice_end > end) slice_end = end;
+        slices[slice] += slice_end - offset;
+        offset = slice_end;
+      }
+    }
+    offset += HEADER_SIZE;
+  }
+  pthread_mutex_unlock(&main_arena.lock);
+
+  pthread_mutex_lock(&huge.lock);
+  huge_count = huge.count;
+  huge_bytes = huge.bytes;
+  pthread_mutex_unlock(&huge.lock);
+
+  for(i = 0; i < SUMMARY_MAP_WIDTH; i++){
+    if(map_busy[i] && map_free[i]) map[i] = '+';
+    else if(map_free[i]) map[i] = '.';
+    else map[i] = '#';
+  }
+  map[SUMMARY_MAP_WIDTH] = '\0';
+
+  fprintf(stdout,"**********************************Heap summary***********************************\n");
+  fprintf(stdout,"Busy blocks = %zu, Total busy size = %zu\n",busy_count,busy_size);
+  fprintf(stdout,"Free blocks = %zu, Total free size = %zu\n",free_count,free_size);
+  fprintf(stdout,"Huge blocks = %zu, Total mapped size = %zu\n",huge_count,huge_bytes);
+  fprintf(stdout,"Largest free block = %zu\n",largest);
+  fprintf(stdout,"External fragmentation = %.1f%%\n",free_size ? 100.0 * (free_size - largest) / free_size : 0.0);
+  fprintf(stdout,"%-24s%-12s%s\n","Free size range","Blocks","Size");
+  for(i = 0; i < SIZE_BITS; i++){
+    if(bucket_count[i] != 0){
+      snprintf(range,sizeof(range),"%zu-%zu",(size_t)1 << i,((size_t)2 << i) - 1);
+      fprintf(stdout,"%-24s%-12zu%zu\n",range,bucket_count[i],bucket_size[i]);
+    }
+  }
+  fprintf(stdout,"Map = [%s]\n",map);
+  fprintf(stdout,"*********************************************************************************\n");
+  fflush(stdout);
+}
@@ -1,11 +1,154 @@
 #ifndef __mem_h__
 #define __mem_h__
 
-int Mem_Init(int sizeOfRegion);
-void* Mem_Alloc(int size);
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mem_arena mem_arena;
+typedef struct mem_scratch mem_scratch;
+
+/* Position in a scratch arena, taken by Mem_ScratchMark and given to Mem_ScratchRewind */
+typedef struct mem_scratch_mark{
+  void *piece;
+  void *next;
+} mem_scratch_mark;
+
+/* Placement policies for Mem_SetPolicy */
+#define MEM_BEST_FIT 0
+#define MEM_FIRST_FIT 1
+#define MEM_NEXT_FIT 2
+#define MEM_GOOD_FIT 3
+
+/*
+ * Live counters of a heap, filled in by Mem_GetStats and Mem_ArenaGetStats
+ * Sizes are in bytes with block headers included
+ */
+#define MEM_STATS_VISIT_BUCKETS 8
+
+struct mem_stats{
+  size_t bytes_busy;      /* everything not in a free block - busy blocks, slabs, cached objects, blocks on quick lists, epilogues */
+  size_t bytes_free;      /* sum of the sizes of all free blocks */
+  size_t largest_free;    /* size of the biggest free block */
+  size_t alloc_count;     /* successful allocations */
+  size_t free_count;      /* successful frees */
+  size_t failed_allocs;   /* allocations of a nonzero size that returned NULL */
+  /* searches of the heap by the number of free blocks they looked at:
+   * bucket 0 counts searches that looked at none, bucket i > 0 those that looked at
+   * 2^(i-1) to 2^i - 1 blocks, the last bucket also counts everything above */
+  size_t visits[MEM_STATS_VISIT_BUCKETS];
+  size_t huge_bytes;      /* mapped for huge blocks, which are not part of any size above */
+  size_t trim_count;      /* trims run by Mem_Trim or by the trim threshold */
+  size_t bytes_trimmed;   /* resident memory given back to the system by all trims */
+  size_t remote_frees;    /* frees left to the next holder of the lock, counted in free_count once done */
+  size_t sweep_count;     /* sweeps of the quick lists with deferred coalescing */
+  size_t calloc_cleared;  /* bytes Mem_Calloc had to clear, the rest was known to be zero */
+};
+
+/*
+ * Allocation traces recorded between Mem_TraceStart and Mem_TraceStop
+ * A trace file is a struct mem_trace_header followed by the events
+ * The events of one thread are in order, but the threads are interleaved in
+ * batches - sort by time to get the order of the whole program
+ */
+#define MEM_TRACE_MAGIC "MEMTRACE"
+#define MEM_TRACE_VERSION 1
+
+#define MEM_TRACE_ALLOC 1     /* ptr = result, size = requested size */
+#define MEM_TRACE_FREE 2      /* ptr = the pointer freed */
+#define MEM_TRACE_REALLOC 3   /* ptr = result, old = the pointer passed in, size = new size */
+
+struct mem_trace_header{
+  char magic[8];          /* MEM_TRACE_MAGIC, not terminated */
+  uint32_t version;       /* MEM_TRACE_VERSION */
+  uint32_t event_size;    /* sizeof(struct mem_trace_event) */
+  uint64_t dropped;       /* events lost because the file was full */
+};
+
+struct mem_trace_event{
+  uint64_t time;          /* cycle counter, or ns if there is none - only good for ordering and deltas */
+  uint64_t ptr;
+  uint64_t old;
+  uint64_t size;
+  uint32_t op;            /* MEM_TRACE_ALLOC, MEM_TRACE_FREE or MEM_TRACE_REALLOC */
+  uint32_t thread;        /* threads are numbered in the order of their first event */
+};
+
+/*
+ * Every chunk of every arena - the main heap, the chunks a growable heap maps,
+ * Mem_ArenaCreate, NUMA arenas, Mem_ShmCreate and Mem_ShmAttach - takes one of
+ * MEM_MAX_REGIONS entries of a table shared by all of them
+ * Creating, growing or attaching fails once the table is full, and the entries
+ * come back when arenas are detached or chunks unmapped
+ */
+#define MEM_MAX_REGIONS 1024
+
+/* Options for Mem_InitEx, to be or'ed together */
+#define MEM_INIT_GROWABLE 0x01      /* map more chunks when full, same as Mem_InitGrowable */
+#define MEM_INIT_ANONYMOUS 0x02     /* map anonymous memory instead of /dev/zero, implied by all options below */
+#define MEM_INIT_HUGETLB_2MB 0x04   /* back the heap with 2 MB hugepages reserved by the system, MAP_HUGETLB */
+#define MEM_INIT_HUGETLB_1GB 0x08   /* back the heap with 1 GB hugepages reserved by the system, MAP_HUGETLB */
+#define MEM_INIT_THP 0x10           /* ask for transparent hugepages with madvise, the heap is 2 MB aligned */
+#define MEM_INIT_POPULATE 0x20      /* fault in every page up front */
+#define MEM_INIT_LOCK 0x40          /* lock the heap into memory with mlock */
+#define MEM_INIT_NUMA 0x80          /* one arena per online NUMA node, sizeOfRegion each */
+
+int Mem_Init(size_t sizeOfRegion);
+int Mem_InitGrowable(size_t sizeOfRegion);
+int Mem_InitEx(size_t sizeOfRegion, int flags);
+int Mem_InitFile(const char *path, size_t sizeOfRegion);
+int Mem_SyncFile(void);
+int Mem_SetFileRoot(void *ptr);
+void* Mem_GetFileRoot(void);
+void* Mem_Alloc(size_t size);
+void* Mem_Calloc(size_t count, size_t size);
+void* Mem_AllocAligned(size_t size, size_t alignment);
+int Mem_AllocBatch(const size_t sizes[], size_t n, void *out[]);
 int Mem_Free(void *ptr);
+int Mem_FreeSized(void *ptr, size_t size);
+void* Mem_Realloc(void *ptr, size_t size);
+size_t Mem_UsableSize(void *ptr);
+int Mem_FreeBatch(void *ptrs[], size_t n);
 void Mem_Dump();
+void Mem_DumpSummary();
 
-#endif // __mem_h__
+mem_arena* Mem_ArenaCreate(size_t sizeOfRegion);
+void* Mem_ArenaAlloc(mem_arena *arena, size_t size);
+int Mem_ArenaFree(mem_arena *arena, void *ptr);
+mem_arena* Mem_ShmCreate(const char *name, size_t sizeOfRegion);
+mem_arena* Mem_ShmAttach(const char *name);
+int Mem_ShmDetach(mem_arena *arena);
+size_t Mem_ArenaOffset(mem_arena *arena, void *ptr);
+void* Mem_ArenaPointer(mem_arena *arena, size_t offset);
+mem_scratch* Mem_ScratchBegin(size_t pieceSize);
+void* Mem_ScratchAlloc(mem_scratch *scratch, size_t size);
+mem_scratch_mark Mem_ScratchMark(mem_scratch *scratch);
+void Mem_ScratchRewind(mem_scratch *scratch, mem_scratch_mark mark);
+void Mem_ScratchReset(mem_scratch *scratch);
+void Mem_ScratchEnd(mem_scratch *scratch);
+int Mem_SetPolicy(int policy);
+int Mem_ArenaSetPolicy(mem_arena *arena, int policy);
+int Mem_SetHugeThreshold(size_t threshold);
+size_t Mem_Trim(void);
+size_t Mem_ArenaTrim(mem_arena *arena);
+int Mem_SetTrimThreshold(size_t threshold);
+int Mem_ArenaSetTrimThreshold(mem_arena *arena, size_t threshold);
+int Mem_SetDeferThreshold(size_t threshold);
+int Mem_ArenaSetDeferThreshold(mem_arena *arena, size_t threshold);
+size_t Mem_Sweep(void);
+size_t Mem_ArenaSweep(mem_arena *arena);
+int Mem_SetThreadNode(int node);
+int Mem_NumaNodes(void);
+int Mem_GetStats(struct mem_stats *stats);
+int Mem_ArenaGetStats(mem_arena *arena, struct mem_stats *stats);
+int Mem_TraceStart(const char *path, size_t maxEvents);
+int Mem_TraceStop(void);
 
+#ifdef __cplusplus
+}
+#endif
 
+#endif // __mem_h__
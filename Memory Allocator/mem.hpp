@@ -0,0 +1,324 @@
+/*
+ * C++ allocators over mem.h, header only, needs C++17
+ *
+ * MemAllocator<T>         - std::allocator compatible, on the main heap or on an arena
+ * MemScratchAllocator<T>  - the same on a scratch arena, deallocate does nothing and
+ *                           everything goes at once with Mem_ScratchRewind or Mem_ScratchReset
+ * MemResource             - std::pmr::memory_resource on the main heap or on an arena
+ * MemScratchResource      - std::pmr::memory_resource on a scratch arena
+ * ObjectPool<T, N>        - objects of type T in blocks of N, in the size class of T
+ *
+ * The allocators are not virtual, so containers using them call straight into
+ * mem.c, the memory resources are for code written against std::pmr
+ * Frees on the main heap pass the size on to Mem_FreeSized, which trusts the size
+ * it is given, so an allocator must only get back the pointers it allocated itself,
+ * with the size it allocated them for - a pointer from anywhere else in the main heap
+ * goes into the thread cache unchecked and breaks the heap later
+ * Allocations which fail throw std::bad_alloc
+ */
+#ifndef __mem_hpp__
+#define __mem_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include "mem.h"
+
+/* Every payload of the heap is aligned to at least this, the size of a block header */
+constexpr std::size_t MEM_MIN_ALIGN = sizeof(std::size_t);
+
+namespace mem_detail {
+
+/*
+ * Allocates 'size' bytes aligned to 'alignment' from 'arena', the main heap if it is nullptr
+ * Arenas have no aligned allocations, so alignments above MEM_MIN_ALIGN only work on the main heap
+ */
+inline void *allocate(mem_arena *arena, std::size_t size, std::size_t alignment){
+	void *ptr;
+
+	if(size == 0) {
+		size = 1;
+	}
+	if(arena != nullptr) {
+		ptr = alignment <= MEM_MIN_ALIGN ? Mem_ArenaAlloc(arena, size) : nullptr;
+	}
+	else {
+		ptr = alignment <= MEM_MIN_ALIGN ? Mem_Alloc(size) : Mem_AllocAligned(size, alignment);
+	}
+	if(ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+inline void deallocate(mem_arena *arena, void *ptr, std::size_t size){
+	if(arena != nullptr) {
+		Mem_ArenaFree(arena, ptr);
+	}
+	else {
+		Mem_FreeSized(ptr, size == 0 ? 1 : size);
+	}
+}
+
+/*
+ * Allocates from a scratch arena, which aligns to MEM_MIN_ALIGN by itself
+ * Bigger alignments take the padding from the scratch arena as well
+ */
+inline void *scratch_allocate(mem_scratch *scratch, std::size_t size, std::size_t alignment){
+	if(alignment <= MEM_MIN_ALIGN) {
+		void *ptr = Mem_ScratchAlloc(scratch, size == 0 ? 1 : size);
+		if(ptr == nullptr) {
+			throw std::bad_alloc();
+		}
+		return ptr;
+	}
+	if(size > std::numeric_limits<std::size_t>::max() - alignment) {
+		throw std::bad_alloc();
+	}
+	char *ptr = static_cast<char*>(Mem_ScratchAlloc(scratch, size + alignment));
+	if(ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+	return ptr + (alignment - reinterpret_cast<std::uintptr_t>(ptr) % alignment) % alignment;
+}
+
+template <typename T>
+inline std::size_t array_size(std::size_t n){
+	if(n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+		throw std::bad_array_new_length();
+	}
+	return n * sizeof(T);
+}
+
+} // namespace mem_detail
+
+/*
+ * std::allocator compatible allocator on the main heap, or on 'arena' if it is given
+ * Copies allocate from the same heap and compare equal
+ */
+template <typename T>
+class MemAllocator{
+public:
+	using value_type = T;
+
+	MemAllocator() noexcept : arena_(nullptr) {}
+	explicit MemAllocator(mem_arena *arena) noexcept : arena_(arena) {}
+	template <typename U>
+	MemAllocator(const MemAllocator<U> &other) noexcept : arena_(other.arena()) {}
+
+	T *allocate(std::size_t n){
+		return static_cast<T*>(mem_detail::allocate(arena_, mem_detail::array_size<T>(n), alignof(T)));
+	}
+
+	void deallocate(T *ptr, std::size_t n) noexcept{
+		mem_detail::deallocate(arena_, ptr, n * sizeof(T));
+	}
+
+	mem_arena *arena() const noexcept{
+		return arena_;
+	}
+
+private:
+	mem_arena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const MemAllocator<T> &a, const MemAllocator<U> &b) noexcept{
+	return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const MemAllocator<T> &a, const MemAllocator<U> &b) noexcept{
+	return a.arena() != b.arena();
+}
+
+/*
+ * std::allocator compatible allocator on the scratch arena 'scratch'
+ * Freeing single objects does nothing, the memory goes back with the scratch arena
+ */
+template <typename T>
+class MemScratchAllocator{
+public:
+	using value_type = T;
+
+	explicit MemScratchAllocator(mem_scratch *scratch) noexcept : scratch_(scratch) {}
+	template <typename U>
+	MemScratchAllocator(const MemScratchAllocator<U> &other) noexcept : scratch_(other.scratch()) {}
+
+	T *allocate(std::size_t n){
+		return static_cast<T*>(mem_detail::scratch_allocate(scratch_, mem_detail::array_size<T>(n), alignof(T)));
+	}
+
+	void deallocate(T*, std::size_t) noexcept {}
+
+	mem_scratch *scratch() const noexcept{
+		return scratch_;
+	}
+
+private:
+	mem_scratch *scratch_;
+};
+
+template <typename T, typename U>
+bool operator==(const MemScratchAllocator<T> &a, const MemScratchAllocator<U> &b) noexcept{
+	return a.scratch() == b.scratch();
+}
+
+template <typename T, typename U>
+bool operator!=(const MemScratchAllocator<T> &a, const MemScratchAllocator<U> &b) noexcept{
+	return a.scratch() != b.scratch();
+}
+
+/*
+ * Memory resource on the main heap, or on 'arena' if it is given
+ */
+class MemResource : public std::pmr::memory_resource{
+public:
+	MemResource() noexcept : arena_(nullptr) {}
+	explicit MemResource(mem_arena *arena) noexcept : arena_(arena) {}
+
+	mem_arena *arena() const noexcept{
+		return arena_;
+	}
+
+private:
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override{
+		return mem_detail::allocate(arena_, bytes, alignment);
+	}
+
+	void do_deallocate(void *ptr, std::size_t bytes, std::size_t) override{
+		mem_detail::deallocate(arena_, ptr, bytes);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override{
+		const MemResource *resource = dynamic_cast<const MemResource*>(&other);
+		return resource != nullptr && resource->arena_ == arena_;
+	}
+
+	mem_arena *arena_;
+};
+
+/*
+ * Memory resource on the scratch arena 'scratch', freeing does nothing
+ */
+class MemScratchResource : public std::pmr::memory_resource{
+public:
+	explicit MemScratchResource(mem_scratch *scratch) noexcept : scratch_(scratch) {}
+
+	mem_scratch *scratch() const noexcept{
+		return scratch_;
+	}
+
+private:
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override{
+		return mem_detail::scratch_allocate(scratch_, bytes, alignment);
+	}
+
+	void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override{
+		const MemScratchResource *resource = dynamic_cast<const MemScratchResource*>(&other);
+		return resource != nullptr && resource->scratch_ == scratch_;
+	}
+
+	mem_scratch *scratch_;
+};
+
+/*
+ * Pool of objects of type T, taken N at a time as one block from the main heap
+ * or from 'arena' if it is given
+ * The slot size is the size class of T - its size rounded up to MEM_MIN_ALIGN
+ * and to its alignment - worked out at compile time, and free slots are kept in
+ * a list through the slots, so objects carry no header and creating one is a pop
+ * The blocks go back when the pool is destroyed, objects still alive are not destroyed
+ * A pool is used by one thread at a time
+ */
+template <typename T, std::size_t N = 64>
+class ObjectPool{
+	static_assert(N > 0, "a block needs at least one slot");
+
+	static constexpr std::size_t slot_align = alignof(T) > MEM_MIN_ALIGN ? alignof(T) : MEM_MIN_ALIGN;
+
+public:
+	static constexpr std::size_t slot_size = (sizeof(T) + slot_align - 1) / slot_align * slot_align;
+
+	ObjectPool() noexcept : arena_(nullptr), free_(nullptr), blocks_(nullptr) {}
+	explicit ObjectPool(mem_arena *arena) noexcept : arena_(arena), free_(nullptr), blocks_(nullptr) {}
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool &operator=(const ObjectPool&) = delete;
+
+	~ObjectPool(){
+		while(blocks_ != nullptr) {
+			Block *next = blocks_->next;
+			mem_detail::deallocate(arena_, blocks_, sizeof(Block));
+			blocks_ = next;
+		}
+	}
+
+	/* Memory for one T, not constructed */
+	void *allocate(){
+		if(free_ == nullptr) {
+			grow();
+		}
+		Slot *slot = free_;
+		free_ = slot->next;
+		return slot;
+	}
+
+	void deallocate(void *ptr) noexcept{
+		Slot *slot = static_cast<Slot*>(ptr);
+		slot->next = free_;
+		free_ = slot;
+	}
+
+	template <typename... Args>
+	T *create(Args&&... args){
+		void *ptr = allocate();
+		try {
+			return new(ptr) T(std::forward<Args>(args)...);
+		}
+		catch(...) {
+			deallocate(ptr);
+			throw;
+		}
+	}
+
+	void destroy(T *object) noexcept{
+		if(object != nullptr) {
+			object->~T();
+			deallocate(object);
+		}
+	}
+
+private:
+	union Slot{
+		Slot *next;
+		alignas(slot_align) unsigned char storage[slot_size];
+	};
+
+	struct Block{
+		Slot slots[N];
+		Block *next;
+	};
+
+	static_assert(sizeof(Slot) == slot_size, "slots are packed at the size class of T");
+
+	void grow(){
+		Block *block = static_cast<Block*>(mem_detail::allocate(arena_, sizeof(Block), alignof(Block)));
+		block->next = blocks_;
+		blocks_ = block;
+		for(std::size_t i = N; i-- > 0; ) {
+			block->slots[i].next = free_;
+			free_ = &block->slots[i];
+		}
+	}
+
+	mem_arena *arena_;
+	Slot *free_;
+	Block *blocks_;
+};
+
+#endif // __mem_hpp__
@@ -0,0 +1,225 @@
+/*
+ * The standard allocation functions on top of mem.c, built into libmempreload.so
+ * (libmempreload64.so) by make preload (make preload64), so that any program can
+ * use the allocator without changes:
+ *
+ *     LD_PRELOAD=./libmempreload64.so program
+ *
+ * The heap is set up with Mem_InitGrowable on the first call, its first chunk
+ * is MEM_PRELOAD_SIZE bytes or the number of bytes in the environment variable
+ * of the same name
+ * Anything the allocator asks for while it is being set up is served from a
+ * small static buffer which is never given back
+ * Memory from malloc has to hold any type, so the allocator linked in is built
+ * with a MEM_ALIGN of at least MALLOC_ALIGN
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+/* alignof(max_align_t) on x86 and x86-64, which glibc malloc aligns to as well */
+#define MALLOC_ALIGN 16
+
+#if !defined(MEM_ALIGN) || MEM_ALIGN < MALLOC_ALIGN
+#error "preload.c and mem.c need a MEM_ALIGN of at least MALLOC_ALIGN, see make preload"
+#endif
+
+#define MEM_PRELOAD_SIZE ((size_t)64 << 20)
+#define BOOT_SIZE (64 * 1024)
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int init_result = -1;
+
+/* Set while the thread sets up the heap */
+static __thread int initializing;
+
+/* Buffer for the allocations made while the heap is set up, every one follows its size */
+static char boot_heap[BOOT_SIZE] __attribute__((aligned(64)));
+static size_t boot_used;
+
+static void init_heap(void){
+	const char *env = getenv("MEM_PRELOAD_SIZE");
+	size_t size = MEM_PRELOAD_SIZE;
+
+	if(env != NULL && strtoull(env, NULL, 0) != 0) {
+		size = strtoull(env, NULL, 0);
+	}
+	initializing = 1;
+	init_result = Mem_InitGrowable(size);
+	initializing = 0;
+}
+
+/*
+ * Sets up the heap on the first call
+ * Returns 0 if the heap can be used and -1 if allocations have to come from the boot buffer
+ */
+static inline int ensure_heap(void){
+	if(initializing) {
+		return -1;
+	}
+	pthread_once(&init_once, init_heap);
+	return init_result;
+}
+
+static inline int is_boot(void *ptr){
+	return (char*)ptr >= boot_heap && (char*)ptr < boot_heap + BOOT_SIZE;
+}
+
+/*
+ * Carves 'size' bytes aligned to 'alignment', a power of two, out of the boot buffer
+ * Returns NULL once the buffer is used up
+ */
+static void *boot_alloc(size_t size, size_t alignment){
+	size_t used = __atomic_load_n(&boot_used, __ATOMIC_RELAXED);
+	size_t start;
+
+	if(alignment < MEM_ALIGN) {
+		alignment = MEM_ALIGN;
+	}
+	do {
+		start = (used + sizeof(size_t) + alignment - 1) & ~(alignment - 1);
+		if(size > BOOT_SIZE || start > BOOT_SIZE - size) {
+			return NULL;
+		}
+	} while(!__atomic_compare_exchange_n(&boot_used, &used, start + size, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	((size_t*)(boot_heap + start))[-1] = size;
+	return boot_heap + start;
+}
+
+static inline size_t boot_size(void *ptr){
+	return ((size_t*)ptr)[-1];
+}
+
+/*
+ * Allocates 'size' bytes aligned to 'alignment', a power of two
+ * Returns NULL and sets errno on failure
+ */
+static void *alloc(size_t size, size_t alignment){
+	void *ptr;
+
+	//malloc(0) still hands out a pointer of its own
+	if(size == 0) {
+		size = 1;
+	}
+	if(ensure_heap() != 0) {
+		ptr = boot_alloc(size, alignment);
+	}
+	else {
+		ptr = alignment <= MEM_ALIGN ? Mem_Alloc(size) : Mem_AllocAligned(size, alignment);
+	}
+	if(ptr == NULL) {
+		errno = ENOMEM;
+	}
+	return ptr;
+}
+
+void *malloc(size_t size){
+	return alloc(size, 0);
+}
+
+void free(void *ptr){
+	if(ptr == NULL || is_boot(ptr)) {
+		return;
+	}
+	Mem_Free(ptr);
+}
+
+/*
+ * The boot buffer is never used twice, so it is still zero
+ */
+void *calloc(size_t count, size_t size){
+	size_t total;
+	void *ptr;
+
+	if(__builtin_mul_overflow(count, size, &total)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if(total == 0 || ensure_heap() != 0) {
+		return alloc(total, 0);
+	}
+	ptr = Mem_Calloc(count, size);
+	if(ptr == NULL) {
+		errno = ENOMEM;
+	}
+	return ptr;
+}
+
+void *realloc(void *ptr, size_t size){
+	void *newPtr;
+
+	if(ptr == NULL) {
+		return alloc(size, 0);
+	}
+	if(is_boot(ptr)) {
+		newPtr = alloc(size, 0);
+		if(newPtr != NULL) {
+			memcpy(newPtr, ptr, boot_size(ptr) < size ? boot_size(ptr) : size);
+		}
+		return newPtr;
+	}
+	if(size == 0) {
+		Mem_Free(ptr);
+		return NULL;
+	}
+	newPtr = Mem_Realloc(ptr, size);
+	if(newPtr == NULL) {
+		errno = ENOMEM;
+	}
+	return newPtr;
+}
+
+/*
+ * Alignments above the page size are more than Mem_AllocAligned does and fail with ENOMEM
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size){
+	void *ptr;
+
+	if(alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void*) != 0) {
+		return EINVAL;
+	}
+	if(alignment > (size_t)getpagesize()) {
+		return ENOMEM;
+	}
+	ptr = alloc(size, alignment);
+	if(ptr == NULL) {
+		return ENOMEM;
+	}
+	*memptr = ptr;
+	return 0;
+}
+
+/*
+ * The other aligned allocations of the C library would take memory from its own
+ * heap, which free could not give back
+ */
+void *aligned_alloc(size_t alignment, size_t size){
+	if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if(alignment > (size_t)getpagesize()) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return alloc(size, alignment);
+}
+
+void *memalign(size_t alignment, size_t size){
+	return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size){
+	return alloc(size, getpagesize());
+}
+
+size_t malloc_usable_size(void *ptr){
+	if(ptr != NULL && is_boot(ptr)) {
+		return boot_size(ptr);
+	}
+	return Mem_UsableSize(ptr);
+}
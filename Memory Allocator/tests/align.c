@@ -8,7 +8,7 @@ int main() {
    assert(Mem_Init(4096) == 0);
    int* ptr = (int*) Mem_Alloc(sizeof(int));
    assert(ptr != NULL);
-   assert((int)ptr % 4 == 0);
+   assert((uintptr_t)ptr % 4 == 0);
    Mem_Dump();
    exit(0);
 }
@@ -15,10 +15,10 @@ int main() {
    ptr[3] = (int*) Mem_Alloc(4);
 
 	Mem_Dump();
-   assert((int)(ptr[0]) % 4 == 0);
-   assert((int)(ptr[1]) % 4 == 0);
-   assert((int)(ptr[2]) % 4 == 0);
-   assert((int)(ptr[3]) % 4 == 0);
+   assert((uintptr_t)(ptr[0]) % 4 == 0);
+   assert((uintptr_t)(ptr[1]) % 4 == 0);
+   assert((uintptr_t)(ptr[2]) % 4 == 0);
+   assert((uintptr_t)(ptr[3]) % 4 == 0);
    Mem_Dump();
    exit(0);
 }
@@ -17,15 +17,15 @@ int main() {
    ptr[7] = (Mem_Alloc(33));
    ptr[8] = (Mem_Alloc(55));
    Mem_Dump();
-   assert((int)(ptr[0]) % 4 == 0);
-   assert((int)(ptr[1]) % 4 == 0);
-   assert((int)(ptr[2]) % 4 == 0);
-   assert((int)(ptr[3]) % 4 == 0);
-   assert((int)(ptr[4]) % 4 == 0);
-   assert((int)(ptr[5]) % 4 == 0);
-   assert((int)(ptr[6]) % 4 == 0);
-   assert((int)(ptr[7]) % 4 == 0);
-   assert((int)(ptr[8]) % 4 == 0);
+   assert((uintptr_t)(ptr[0]) % 4 == 0);
+   assert((uintptr_t)(ptr[1]) % 4 == 0);
+   assert((uintptr_t)(ptr[2]) % 4 == 0);
+   assert((uintptr_t)(ptr[3]) % 4 == 0);
+   assert((uintptr_t)(ptr[4]) % 4 == 0);
+   assert((uintptr_t)(ptr[5]) % 4 == 0);
+   assert((uintptr_t)(ptr[6]) % 4 == 0);
+   assert((uintptr_t)(ptr[7]) % 4 == 0);
+   assert((uintptr_t)(ptr[8]) % 4 == 0);
 
    exit(0);
 }
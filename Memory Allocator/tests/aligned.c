@@ -0,0 +1,38 @@
+/* allocations with alignments up to the page size */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(16384) == 0);
+   size_t alignment[] = { 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+   void* ptr[9];
+   void* small[9];
+   int i;
+
+   for (i = 0; i < 9; i++) {
+      ptr[i] = Mem_AllocAligned(100 + i, alignment[i]);
+      assert(ptr[i] != NULL);
+      assert((uintptr_t)ptr[i] % alignment[i] == 0);
+      memset(ptr[i], i, 100 + i);
+      // odd sizes in between so the next block starts unaligned
+      small[i] = Mem_Alloc(13);
+      assert(small[i] != NULL);
+   }
+
+   // not a power of two or bigger than a page
+   assert(Mem_AllocAligned(100, 24) == NULL);
+   assert(Mem_AllocAligned(100, 0) == NULL);
+   assert(Mem_AllocAligned(100, 8192) == NULL);
+Mem_Dump();
+   for (i = 0; i < 9; i++) {
+      assert(Mem_Free(ptr[i]) == 0);
+      assert(Mem_Free(small[i]) == 0);
+   }
+
+   // the padding blocks coalesced with everything else
+   assert(Mem_Alloc(16000) != NULL);
+   exit(0);
+}
@@ -0,0 +1,134 @@
+/* the C++ allocators of mem.hpp put standard containers and pooled objects on the heap, an arena or a scratch arena */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mem.hpp"
+
+struct alignas(64) Wide {
+   char bytes[100];
+};
+
+struct Node {
+   Node(int v, Node* n) : value(v), next(n) {}
+   int value;
+   Node* next;
+};
+
+static size_t frees() {
+   struct mem_stats stats;
+   assert(Mem_GetStats(&stats) == 0);
+   return stats.free_count;
+}
+
+int main() {
+   assert(Mem_Init(4 << 20) == 0);
+   mem_arena* arena = Mem_ArenaCreate(1 << 20);
+   assert(arena != NULL);
+
+   // containers on the main heap, over-aligned types included
+   {
+      std::vector<int, MemAllocator<int>> numbers;
+      for (int i = 0; i < 10000; i++)
+         numbers.push_back(i);
+      assert(numbers[9999] == 9999 && Mem_UsableSize(numbers.data()) >= 10000 * sizeof(int));
+      std::vector<Wide, MemAllocator<Wide>> wide(10);
+      assert((uintptr_t)wide.data() % 64 == 0);
+      std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, MemAllocator<std::pair<const int, int>>> map;
+      for (int i = 0; i < 1000; i++)
+         map[i] = i * 2;
+      assert(map.size() == 1000 && map[500] == 1000);
+   }
+
+   // and on an arena, rebound allocators use the arena as well
+   {
+      MemAllocator<int> allocator(arena);
+      std::map<int, int, std::less<int>, MemAllocator<std::pair<const int, int>>> map(allocator);
+      for (int i = 0; i < 1000; i++)
+         map[i] = i;
+      assert(map.get_allocator() == MemAllocator<char>(arena));
+      assert(map.get_allocator() != MemAllocator<char>());
+      int* ptr = allocator.allocate(100);
+      struct mem_stats stats;
+      assert(Mem_ArenaGetStats(arena, &stats) == 0);
+      assert(stats.alloc_count >= 1001);
+      allocator.deallocate(ptr, 100);
+   }
+   bool thrown = false;
+   try {
+      MemAllocator<Wide>(arena).allocate(1);
+   } catch (const std::bad_alloc&) {
+      thrown = true;
+   }
+   assert(thrown);
+
+   // sized frees of small objects go straight to the thread cache
+   size_t before = frees();
+   void* small = Mem_Alloc(24);
+   assert(Mem_FreeSized(small, 24) == 0);
+   void* big = Mem_Alloc(5000);
+   assert(Mem_FreeSized(big, 5000) == 0);
+   assert(Mem_FreeSized(big, 5000) == -1);
+   assert(frees() == before + 2);
+
+   // memory resources for std::pmr containers
+   {
+      MemResource heap, onArena(arena), alsoOnArena(arena);
+      assert(onArena.is_equal(alsoOnArena) && !heap.is_equal(onArena));
+      std::pmr::vector<std::pmr::string> strings(&onArena);
+      for (int i = 0; i < 100; i++)
+         strings.emplace_back(std::string(50, 'a' + i % 26));
+      assert(strings[27] == std::string(50, 'b').c_str());
+      void* aligned = heap.allocate(300, 256);
+      assert((uintptr_t)aligned % 256 == 0);
+      heap.deallocate(aligned, 300, 256);
+   }
+
+   // a scratch arena per request, everything goes at once
+   mem_scratch* scratch = Mem_ScratchBegin(0);
+   assert(scratch != NULL);
+   mem_scratch_mark mark = Mem_ScratchMark(scratch);
+   {
+      MemScratchResource resource(scratch);
+      std::pmr::unordered_map<int, int> map(&resource);
+      for (int i = 0; i < 1000; i++)
+         map[i] = i;
+      std::vector<Wide, MemScratchAllocator<Wide>> wide(3, Wide(), MemScratchAllocator<Wide>(scratch));
+      assert((uintptr_t)wide.data() % 64 == 0);
+      assert(map[999] == 999);
+   }
+   Mem_ScratchRewind(scratch, mark);
+   Mem_ScratchEnd(scratch);
+
+   // pooled objects sit in the size class of their type, N to a block
+   static_assert(ObjectPool<Node>::slot_size == sizeof(Node), "packed");
+   static_assert(ObjectPool<char>::slot_size == sizeof(size_t), "one header");
+   static_assert(ObjectPool<Wide>::slot_size == 128, "its alignment");
+   {
+      struct mem_stats stats;
+      ObjectPool<Node, 32> pool;
+      Node* list = NULL;
+      assert(Mem_GetStats(&stats) == 0);
+      size_t allocs = stats.alloc_count;
+      for (int i = 0; i < 100; i++)
+         list = pool.create(i, list);
+      assert(Mem_GetStats(&stats) == 0);
+      assert(stats.alloc_count == allocs + 4);
+      while (list != NULL) {
+         Node* next = list->next;
+         pool.destroy(list);
+         list = next;
+      }
+      Node* again = pool.create(7, (Node*)NULL);
+      assert(again->value == 7);
+      pool.destroy(again);
+      ObjectPool<Wide, 4> widePool(NULL);
+      assert((uintptr_t)widePool.allocate() % 64 == 0);
+   }
+   exit(0);
+}
@@ -0,0 +1,42 @@
+/* allocations from independent arenas freed through Mem_Free and Mem_ArenaFree */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   mem_arena* arena[2];
+   void* ptr[4];
+
+   arena[0] = Mem_ArenaCreate(4096);
+   assert(arena[0] != NULL);
+   arena[1] = Mem_ArenaCreate(8192);
+   assert(arena[1] != NULL);
+
+   ptr[0] = Mem_Alloc(1000);
+   assert(ptr[0] != NULL);
+   ptr[1] = Mem_ArenaAlloc(arena[0], 1000);
+   assert(ptr[1] != NULL);
+   ptr[2] = Mem_ArenaAlloc(arena[1], 6000);
+   assert(ptr[2] != NULL);
+   ptr[3] = Mem_ArenaAlloc(arena[1], 1000);
+   assert(ptr[3] != NULL);
+
+   // arenas are separate heaps
+   assert(Mem_ArenaAlloc(arena[0], 7000) == NULL);
+   assert(Mem_ArenaFree(arena[0], ptr[2]) == -1);
+   assert(Mem_ArenaFree(arena[1], ptr[0]) == -1);
+
+   // Mem_Free finds the owning arena
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[2]) == 0);
+   assert(Mem_ArenaFree(arena[1], ptr[3]) == 0);
+
+   // everything coalesced back in each arena
+   assert(Mem_ArenaAlloc(arena[0], 3000) != NULL);
+   assert(Mem_ArenaAlloc(arena[1], 7000) != NULL);
+   assert(Mem_Alloc(4000) != NULL);
+   Mem_Dump();
+   exit(0);
+}
@@ -0,0 +1,45 @@
+/* a batch is carved side by side out of one free block and freed again in one go */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   size_t sizes[5] = {10, 100, 30, 200, 8};
+   size_t too_big[2] = {100, 100000};
+   void* ptr[5];
+   void* shuffled[6];
+   int i, x;
+
+   assert(Mem_AllocBatch(sizes, 5, ptr) == 0);
+   for (i = 0; i < 5; i++) {
+      assert(ptr[i] != NULL);
+      memset(ptr[i], 'a' + i, sizes[i]);
+   }
+   // the blocks follow each other in the order they were asked for
+   for (i = 1; i < 5; i++) {
+      assert((char*)ptr[i] >= (char*)ptr[i - 1] + sizes[i - 1]);
+      assert((char*)ptr[i] < (char*)ptr[i - 1] + sizes[i - 1] + 64);
+   }
+   for (i = 0; i < 5; i++)
+      assert(((char*)ptr[i])[sizes[i] - 1] == 'a' + i);
+
+   // a batch that does not fit allocates nothing
+   assert(Mem_AllocBatch(too_big, 2, shuffled) == -1);
+   assert(shuffled[0] == NULL && shuffled[1] == NULL);
+
+   // freed in any order, invalid pointers fail without stopping the others
+   shuffled[0] = ptr[3];
+   shuffled[1] = ptr[0];
+   shuffled[2] = &x;
+   shuffled[3] = ptr[4];
+   shuffled[4] = ptr[1];
+   shuffled[5] = ptr[2];
+   assert(Mem_FreeBatch(shuffled, 6) == -1);
+   // none of them can be freed again, the blocks merged into one
+   for (i = 0; i < 5; i++)
+      assert(Mem_Free(ptr[i]) == -1);
+   assert(Mem_Alloc(4000) != NULL);
+   exit(0);
+}
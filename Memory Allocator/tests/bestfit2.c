@@ -0,0 +1,40 @@
+/* check for best fit among free blocks of the same size class */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   void* ptr[6];
+   void* test;
+
+   ptr[0] = Mem_Alloc(600);
+   assert(ptr[0] != NULL);
+
+   ptr[1] = Mem_Alloc(100);
+   assert(ptr[1] != NULL);
+
+   ptr[2] = Mem_Alloc(520);
+   assert(ptr[2] != NULL);
+
+   ptr[3] = Mem_Alloc(100);
+   assert(ptr[3] != NULL);
+
+   ptr[4] = Mem_Alloc(560);
+   assert(ptr[4] != NULL);
+
+   ptr[5] = Mem_Alloc(100);
+   assert(ptr[5] != NULL);
+
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_Free(ptr[4]) == 0);
+   assert(Mem_Free(ptr[2]) == 0);
+
+   test = Mem_Alloc(510);
+   assert(test == ptr[2]);
+
+   test = Mem_Alloc(540);
+   assert(test == ptr[4]);
+Mem_Dump();
+   exit(0);
+}
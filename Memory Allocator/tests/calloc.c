@@ -0,0 +1,110 @@
+/* Mem_Calloc hands out zeroed memory and only clears what was handed out before */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+static int zero(char* ptr, size_t size) {
+   size_t i;
+   for (i = 0; i < size; i++)
+      if (ptr[i] != 0) return 0;
+   return 1;
+}
+
+// bytes Mem_Calloc cleared so far
+static size_t cleared() {
+   struct mem_stats stats;
+   assert(Mem_GetStats(&stats) == 0);
+   return stats.calloc_cleared;
+}
+
+int main() {
+   assert(Mem_Init(1 << 20) == 0);
+   struct mem_stats stats;
+   size_t before, total;
+   uintptr_t end;
+   char *ptr, *dirty;
+
+   // nothing was handed out yet, only the links and the footer of the free block are cleared
+   ptr = Mem_Calloc(1000, 100);
+   assert(ptr != NULL && zero(ptr, 100000));
+   assert(cleared() < 100);
+   memset(ptr, 'a', 100000);
+   assert(Mem_Free(ptr) == 0);
+
+   // the same memory again has to be cleared
+   before = cleared();
+   ptr = Mem_Calloc(100, 1000);
+   assert(ptr != NULL && zero(ptr, 100000));
+   assert(cleared() >= before + 100000);
+   assert(Mem_Free(ptr) == 0);
+
+   // only the part which was used before
+   before = cleared();
+   ptr = Mem_Calloc(200000, 1);
+   assert(ptr != NULL && zero(ptr, 200000));
+   assert(cleared() >= before + 100000 && cleared() < before + 100100);
+   memset(ptr, 'b', 200000);
+   assert(Mem_Free(ptr) == 0);
+
+   // small ones and ones taken back from the quick lists are always cleared
+   dirty = Mem_Alloc(40);
+   assert(dirty != NULL);
+   memset(dirty, 'c', 40);
+   assert(Mem_Free(dirty) == 0);
+   ptr = Mem_Calloc(10, 4);
+   assert(ptr != NULL && zero(ptr, 40));
+   assert(Mem_Free(ptr) == 0);
+   assert(Mem_SetDeferThreshold(1 << 20) == 0);
+   dirty = Mem_Alloc(500);
+   assert(dirty != NULL);
+   memset(dirty, 'd', 500);
+   assert(Mem_Free(dirty) == 0);
+   ptr = Mem_Calloc(1, 500);
+   assert(ptr == dirty && zero(ptr, 500));
+   assert(Mem_Free(ptr) == 0);
+   assert(Mem_SetDeferThreshold(0) == 0);
+
+   // trimming the end of the heap zeroes it again
+   assert(Mem_Trim() > 0);
+   before = cleared();
+   ptr = Mem_Calloc(500000, 1);
+   assert(ptr != NULL && zero(ptr, 500000));
+   assert(cleared() < before + 2 * getpagesize());
+   assert(Mem_Free(ptr) == 0);
+
+   // a trim right below the mark clears the header left at the mark, past the last page it gives back
+   assert(Mem_GetStats(&stats) == 0);
+   total = stats.largest_free - sizeof(size_t);
+   dirty = Mem_Alloc(total - getpagesize());
+   assert(dirty != NULL && Mem_Free(dirty) == 0);
+   end = ((uintptr_t)dirty + total - sizeof(size_t)) & ~((uintptr_t)getpagesize() - 1);
+   assert(Mem_Trim() > 0);
+   ptr = Mem_Alloc(end - (uintptr_t)dirty);
+   assert(ptr == dirty);
+   memset(ptr, 'e', end - (uintptr_t)dirty);
+   assert(Mem_Free(ptr) == 0);
+   assert(Mem_Trim() > 0);
+   ptr = Mem_Calloc(1, total);
+   assert(ptr == dirty && zero(ptr, total));
+   assert(Mem_Free(ptr) == 0);
+
+   // huge blocks are fresh mappings
+   assert(Mem_SetHugeThreshold(256 * 1024) == 0);
+   before = cleared();
+   ptr = Mem_Calloc(1 << 10, 1 << 10);
+   assert(ptr != NULL && zero(ptr, 1 << 20));
+   assert(cleared() == before);
+   assert(Mem_Free(ptr) == 0);
+
+   // the size must not overflow
+   assert(Mem_GetStats(&stats) == 0);
+   assert(Mem_Calloc(SIZE_MAX / 2, 4) == NULL);
+   assert(Mem_Calloc(0, 4) == NULL);
+   before = stats.failed_allocs;
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.failed_allocs == before + 1);
+   exit(0);
+}
@@ -0,0 +1,62 @@
+/* with deferred coalescing freed blocks are reused at their exact size and only coalesce in a sweep */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   struct mem_stats full, stats;
+   void *ptr[5], *again;
+   int i;
+
+   assert(Mem_ArenaSetDeferThreshold(NULL, 100) == -1);
+   assert(Mem_SetDeferThreshold(1 << 20) == 0);
+
+   // the same size comes back as it was, without being split again
+   for (i = 0; i < 5; i++) {
+      ptr[i] = Mem_Alloc(600);
+      assert(ptr[i] != NULL);
+   }
+   while (Mem_Alloc(600) != NULL)
+      ;
+   assert(Mem_GetStats(&full) == 0);
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[3]) == 0);
+   assert(Mem_Free(ptr[2]) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.sweep_count == 0 && stats.bytes_free == full.bytes_free);
+   again = Mem_Alloc(600);
+   assert(again == ptr[2]);
+   assert(Mem_Free(again) == 0);
+
+   // no single free block fits, so the allocation sweeps and the three coalesce like in coalesce3
+   again = Mem_Alloc(1800);
+   assert(again == ptr[1]);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.sweep_count == 1);
+
+   // blocks above 1024 bytes coalesce right away, an explicit sweep coalesces the rest
+   assert(Mem_Free(again) == 0);
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_Sweep() == 608);
+   assert(Mem_Sweep() == 0);
+   assert(Mem_Alloc(2400) == ptr[0]);
+
+   // the threshold sweeps once enough is waiting, turning it off sweeps as well
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_SetDeferThreshold(1000) == 0);
+   ptr[0] = Mem_Alloc(500);
+   ptr[1] = Mem_Alloc(500);
+   assert(ptr[0] != NULL && ptr[1] != NULL);
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.sweep_count == 2);
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.sweep_count == 3);
+   assert(Mem_Free(ptr[4]) == 0);
+   assert(Mem_SetDeferThreshold(0) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.sweep_count == 4);
+   exit(0);
+}
@@ -0,0 +1,122 @@
+/* a heap kept in a file is reopened where it was left, with its blocks, free lists and root, and refused if it was not synced */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define NODES 1000
+
+struct node {
+   struct node* next;
+   int value;
+   char text[100];
+};
+
+static char path[64];
+
+// builds a list of NODES nodes with every other one freed again
+static void create(void) {
+   struct node *head = NULL, *node, *gap = NULL;
+   int i;
+
+   assert(Mem_InitFile(path, 1 << 20) == 0);
+   assert(Mem_GetFileRoot() == NULL);
+   assert(Mem_SetHugeThreshold(1 << 20) == -1);
+   for (i = 0; i < 2 * NODES; i++) {
+      node = Mem_Alloc(i % 2 ? sizeof(struct node) : 1 + i % 300);
+      assert(node != NULL);
+      if (i % 2 == 0) {
+         if (gap != NULL) assert(Mem_Free(gap) == 0);
+         gap = node;
+         continue;
+      }
+      node->next = head;
+      node->value = i / 2;
+      snprintf(node->text, sizeof(node->text), "node %d", i / 2);
+      head = node;
+   }
+   assert(Mem_SetFileRoot(&i) == -1);
+   assert(Mem_SetFileRoot(head) == 0);
+   // synced again on exit
+}
+
+// finds the list again and checks the heap around it still works
+static void reopen(void) {
+   struct mem_stats stats;
+   struct node* node;
+   char text[100];
+   int i = NODES;
+
+   assert(Mem_InitFile(path, 0) == 0);
+   for (node = Mem_GetFileRoot(); node != NULL; node = node->next) {
+      i--;
+      snprintf(text, sizeof(text), "node %d", i);
+      assert(node->value == i && strcmp(node->text, text) == 0);
+   }
+   assert(i == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.alloc_count == 2 * NODES && stats.free_count == NODES - 1);
+
+   // the free blocks are where they were left
+   node = Mem_Alloc(300);
+   assert(node != NULL);
+   assert(Mem_Free(node) == 0);
+   for (node = Mem_GetFileRoot(); node != NULL; node = node->next)
+      assert(Mem_Free(node) == 0);
+   assert(Mem_SetFileRoot(NULL) == 0);
+   assert(Mem_SyncFile() == 0);
+
+   // changed after the sync and never synced again
+   assert(Mem_Alloc(100) != NULL);
+   _exit(0);
+}
+
+static void refused(size_t size) {
+   assert(Mem_InitFile(path, size) == -1);
+   assert(Mem_Alloc(100) == NULL);
+   assert(Mem_SyncFile() == -1);
+}
+
+// runs 'test' in a process of its own since the heap can only be set up once
+static void run(void (*test)(void)) {
+   pid_t pid = fork();
+   int status;
+   assert(pid >= 0);
+   if (pid == 0) {
+      test();
+      exit(0);
+   }
+   assert(waitpid(pid, &status, 0) == pid);
+   assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void refused_unsynced(void) {
+   refused(0);
+}
+
+static void refused_foreign(void) {
+   FILE* file = fopen(path, "w");
+   assert(file != NULL);
+   assert(fprintf(file, "not a heap, but long enough to hold the superblock of one %0*d", 4096, 0) > 0);
+   fclose(file);
+   refused(0);
+}
+
+int main() {
+   snprintf(path, sizeof(path), "/tmp/mem_file_%d", (int)getpid());
+   unlink(path);
+
+   run(create);
+   run(reopen);
+   run(refused_unsynced);
+   run(refused_foreign);
+   unlink(path);
+
+   // a new file needs a size
+   refused(0);
+   unlink(path);
+   exit(0);
+}
@@ -0,0 +1,50 @@
+/* frees of pointers that are not the payload of a busy block fail and leave the heap intact */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   char* ptr[4];
+   int x;
+
+   ptr[0] = Mem_Alloc(200);
+   ptr[1] = Mem_Alloc(200);
+   ptr[2] = Mem_Alloc(200);
+   assert(ptr[0] != NULL && ptr[1] != NULL && ptr[2] != NULL);
+   memset(ptr[1], 0, 200);
+
+   assert(Mem_Free(NULL) == -1);
+   assert(Mem_Free(&x) == -1);
+   assert(Mem_Free(ptr[1] + 1) == -1);
+   // pointer into the middle of a busy block
+   assert(Mem_Free(ptr[1] + 64) == -1);
+
+   // double free of a block with busy neighbours
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[1]) == -1);
+
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_Free(ptr[2]) == 0);
+
+   // double free of a block which merged with free blocks on both sides
+   for (x = 0; x < 4; x++)
+      assert((ptr[x] = Mem_Alloc(200)) != NULL);
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_Free(ptr[2]) == 0);
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[1]) == -1);
+   assert(Mem_Free(ptr[2]) == -1);
+
+   // and of one which only merged backward
+   assert(Mem_Free(ptr[3]) == 0);
+   assert((ptr[0] = Mem_Alloc(200)) != NULL && (ptr[1] = Mem_Alloc(200)) != NULL);
+   assert((ptr[2] = Mem_Alloc(200)) != NULL);
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[1]) == -1);
+   assert(Mem_Free(ptr[2]) == 0);
+   assert(Mem_Alloc(4000) != NULL);
+   exit(0);
+}
@@ -0,0 +1,49 @@
+/* blocks freed with Mem_FreeSized come back only for sizes they have room for, pointers outside the main heap are freed like with Mem_Free */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+static size_t stray;
+
+int main() {
+   // there is no heap to free into yet
+   assert(Mem_FreeSized(&stray, 8) == -1);
+   assert(Mem_Init(1 << 20) == 0);
+   char *ptrs[64], *a, *b, *c;
+   size_t size;
+
+   // an aligned block of 20 bytes may have no room for 32
+   a = Mem_AllocAligned(20, 32);
+   b = Mem_Alloc(20);
+   assert(a != NULL && b != NULL);
+   assert(Mem_FreeSized(a, 20) == 0);
+   c = Mem_Alloc(32);
+   assert(c != NULL && Mem_UsableSize(c) >= 32);
+   memset(c, 'a', 32);
+   assert(Mem_Free(b) == 0);
+   assert(Mem_Free(c) == 0);
+
+   // every size the caches serve, freed with its size and handed out again
+   for (size = 1; size <= 64; size++) {
+      ptrs[size - 1] = Mem_AllocAligned(size, 64);
+      assert(ptrs[size - 1] != NULL);
+   }
+   for (size = 1; size <= 64; size++)
+      assert(Mem_FreeSized(ptrs[size - 1], size) == 0);
+   for (size = 64; size >= 1; size--) {
+      ptrs[size - 1] = Mem_Alloc(size);
+      assert(ptrs[size - 1] != NULL && Mem_UsableSize(ptrs[size - 1]) >= size);
+      memset(ptrs[size - 1], 'b', size);
+   }
+   for (size = 1; size <= 64; size++)
+      assert(Mem_FreeSized(ptrs[size - 1], size) == 0);
+
+   // pointers outside the main heap are freed like with Mem_Free
+   mem_arena* arena = Mem_ArenaCreate(4096);
+   assert(arena != NULL);
+   a = Mem_ArenaAlloc(arena, 20);
+   assert(a != NULL && Mem_FreeSized(a, 20) == 0 && Mem_FreeSized(a, 20) == -1);
+   assert(Mem_FreeSized(&stray, 8) == -1);
+   exit(0);
+}
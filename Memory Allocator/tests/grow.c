@@ -0,0 +1,33 @@
+/* growable heap maps more chunks when full and unmaps them once empty */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_InitGrowable(4096) == 0);
+   void* ptr[16];
+   int i;
+
+   // far more than the first chunk can hold
+   for (i = 0; i < 16; i++) {
+      ptr[i] = Mem_Alloc(1000);
+      assert(ptr[i] != NULL);
+   }
+   // a block bigger than all chunks so far
+   void* big = Mem_Alloc(100000);
+   assert(big != NULL);
+   Mem_Dump();
+
+   assert(Mem_Free(big) == 0);
+   for (i = 15; i >= 0; i--)
+      assert(Mem_Free(ptr[i]) == 0);
+
+   // the chunks added for the allocations are gone, their addresses are not part of the heap anymore
+   assert(Mem_Free(big) == -1);
+   assert(Mem_Free(ptr[15]) == -1);
+   Mem_Dump();
+
+   // the first chunk is kept
+   assert(Mem_Alloc(4000) != NULL);
+   exit(0);
+}
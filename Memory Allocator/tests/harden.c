@@ -0,0 +1,108 @@
+/* double and stray frees fail in every build, a hardened build also catches writes past a block and after a free */
+#include <assert.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+// runs 'test' in a process of its own, returns the signal it was killed by or 0
+static int run(void (*test)(void)) {
+   pid_t pid = fork();
+   int status;
+   assert(pid >= 0);
+   if (pid == 0) {
+      close(2);
+      test();
+      exit(0);
+   }
+   assert(waitpid(pid, &status, 0) == pid);
+   return WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+}
+
+// one word past the payload of a 112 byte block, up to the next header
+static void overflow(void) {
+   char* ptr = Mem_Alloc(112);
+   memset(ptr, 'a', 120);
+   Mem_Free(ptr);
+}
+
+static void use_after_free(void) {
+   char* ptr = Mem_Alloc(112);
+   int i;
+   Mem_Free(ptr);
+   memset(ptr, 'a', 120);
+   for (i = 0; i < 100; i++)
+      Mem_Free(Mem_Alloc(112));
+}
+
+// the same for blocks freed together, which are not merged past the quarantine
+static void use_after_batch_free(void) {
+   void* ptrs[2] = {Mem_Alloc(112), Mem_Alloc(112)};
+   int i;
+   Mem_FreeBatch(ptrs, 2);
+   memset(ptrs[0], 'a', 120);
+   for (i = 0; i < 100; i++)
+      Mem_Free(Mem_Alloc(112));
+}
+
+int main() {
+   assert(Mem_Init(1 << 20) == 0);
+   char *ptr, *other;
+   int hardened, i;
+   size_t size;
+
+   // only a hardened build keeps a block away from the next allocation
+   ptr = Mem_Alloc(100);
+   assert(ptr != NULL);
+   assert(Mem_Free(ptr) == 0);
+   other = Mem_Alloc(100);
+   hardened = other != ptr;
+   assert(Mem_Free(other) == 0);
+
+   // freed twice, right away and once it is really free
+   ptr = Mem_Alloc(200);
+   assert(Mem_Free(ptr) == 0);
+   assert(Mem_Free(ptr) == -1);
+   for (i = 0; i < 100; i++)
+      assert(Mem_Free(Mem_Alloc(200)) == 0);
+   assert(Mem_Free(ptr) == -1);
+   assert(Mem_Realloc(ptr, 300) == NULL);
+
+   // not the start of a block
+   ptr = Mem_Alloc(200);
+   assert(Mem_Free(ptr + 8) == -1 && Mem_Free(ptr + 1) == -1);
+   assert(Mem_Free(ptr) == 0);
+
+   // everything stays usable
+   ptr = Mem_Realloc(Mem_Alloc(50), 5000);
+   assert(ptr != NULL);
+   memset(ptr, 'b', 5000);
+   ptr = Mem_Realloc(ptr, 100);
+   assert(ptr != NULL && ptr[99] == 'b');
+   assert(Mem_Free(ptr) == 0);
+
+   // blocks leaving the quarantine are freed for good, small ones and ones
+   // which would wait on a quick list included
+   if (hardened) {
+      assert(Mem_SetDeferThreshold(1 << 20) == 0);
+      for (size = 24; size <= 200; size += 176) {
+         ptr = Mem_Alloc(size);
+         assert(ptr != NULL && Mem_Free(ptr) == 0);
+         for (i = 0; i < 100; i++)
+            assert(Mem_Free(Mem_Alloc(2000)) == 0);
+         assert(Mem_Free(ptr) == -1);
+         other = Mem_Alloc(size);
+         assert(other != NULL && Mem_Alloc(size) != other);
+      }
+      assert(Mem_SetDeferThreshold(0) == 0);
+   }
+
+   if (hardened) {
+      assert(run(overflow) == SIGABRT);
+      assert(run(use_after_free) == SIGABRT);
+      assert(run(use_after_batch_free) == SIGABRT);
+   }
+   exit(0);
+}
@@ -0,0 +1,74 @@
+/* requests above the huge threshold get a mapping of their own which is resized with mremap and unmapped on free */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+static int filled(char* ptr, size_t size, char c) {
+   size_t i;
+   for (i = 0; i < size; i++)
+      if (ptr[i] != c) return 0;
+   return 1;
+}
+
+int main() {
+   assert(Mem_Init(65536) == 0);
+   struct mem_stats before, stats;
+   char *big, *aligned, *small;
+   size_t mb = 1 << 20;
+
+   // a fixed heap keeps everything in its region by default
+   assert(Mem_Alloc(mb) == NULL);
+   assert(Mem_SetHugeThreshold(100) == -1);
+   assert(Mem_SetHugeThreshold(128 * 1024) == 0);
+   assert(Mem_GetStats(&before) == 0);
+   assert(before.huge_bytes == 0);
+
+   big = Mem_Alloc(mb);
+   assert(big != NULL && (uintptr_t)big % sizeof(void*) == 0);
+   memset(big, 'a', mb);
+   aligned = Mem_AllocAligned(200000, 4096);
+   assert(aligned != NULL && (uintptr_t)aligned % 4096 == 0);
+   memset(aligned, 'b', 200000);
+
+   // the heap itself is untouched
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.bytes_free == before.bytes_free);
+   assert(stats.huge_bytes >= mb + 200000 && stats.huge_bytes < mb + 200000 + 4 * 4096);
+   assert(stats.alloc_count == before.alloc_count + 2);
+
+   // grows with mremap, the contents come along
+   big = Mem_Realloc(big, 8 * mb);
+   assert(big != NULL && filled(big, mb, 'a'));
+   memset(big, 'c', 8 * mb);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.huge_bytes >= 8 * mb + 200000);
+
+   // shrinks below the threshold into the heap
+   small = Mem_Realloc(aligned, 1000);
+   assert(small != NULL && filled(small, 1000, 'b'));
+   assert(Mem_Free(aligned) == -1);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.huge_bytes <= 8 * mb + 4096 && stats.bytes_free < before.bytes_free);
+
+   // and a heap block growing past the threshold moves out of the heap
+   aligned = Mem_Realloc(small, 300000);
+   assert(aligned != NULL && filled(aligned, 1000, 'b'));
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.bytes_free == before.bytes_free);
+
+   assert(Mem_Free(big + 8) == -1);
+   assert(Mem_Free(big) == 0);
+   assert(Mem_Free(big) == -1);
+   assert(Mem_Free(aligned) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.huge_bytes == 0);
+   assert(stats.free_count == stats.alloc_count - before.alloc_count + before.free_count);
+
+   // off again, big requests fail in a heap this small
+   assert(Mem_SetHugeThreshold(0) == 0);
+   assert(Mem_Alloc(mb) == NULL);
+   exit(0);
+}
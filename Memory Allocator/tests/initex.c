@@ -0,0 +1,107 @@
+/* Mem_InitEx maps the heap with the requested options and rejects unknown or conflicting ones */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define MB ((size_t)1 << 20)
+
+// 1 if all pages of [start, start + size) are resident
+static int resident(uintptr_t start, size_t size) {
+   size_t pagesize = getpagesize(), i;
+   unsigned char* vec = malloc(size / pagesize + 1);
+   int all = 1;
+   assert(vec != NULL);
+   assert(mincore((void*)start, size, vec) == 0);
+   for (i = 0; i < size / pagesize; i++)
+      all &= vec[i] & 1;
+   free(vec);
+   return all;
+}
+
+// sets up a heap of 'size' bytes with 'flags' and checks it, returns the size of the heap
+static size_t check(size_t size, int flags) {
+   struct mem_stats stats;
+   size_t total;
+   char* ptr;
+
+   assert(Mem_InitEx(size, flags) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   total = stats.bytes_busy + stats.bytes_free;
+   assert(total + 64 >= size && total <= size + 2 * MB);
+
+   // the first block starts the region
+   ptr = Mem_Alloc(1000);
+   assert(ptr != NULL);
+   memset(ptr, 'a', 1000);
+   uintptr_t base = (uintptr_t)ptr & ~((uintptr_t)getpagesize() - 1);
+   if (flags & MEM_INIT_THP)
+      assert((uintptr_t)ptr % (2 * MB) < 64);
+   if (flags & (MEM_INIT_POPULATE | MEM_INIT_LOCK))
+      assert(resident(base, total & ~((size_t)getpagesize() - 1)));
+   else if (!(flags & MEM_INIT_THP))
+      assert(!resident(base, total & ~((size_t)getpagesize() - 1)));
+   assert(Mem_Free(ptr) == 0);
+   return total;
+}
+
+// runs 'check' in a process of its own since Mem_Init can only be called once
+static void run(size_t size, int flags, int works) {
+   pid_t pid = fork();
+   int status;
+   assert(pid >= 0);
+   if (pid == 0) {
+      if (!works) {
+         assert(Mem_InitEx(size, flags) == -1);
+         exit(0);
+      }
+      size_t total = check(size, flags);
+      if (flags & MEM_INIT_GROWABLE) {
+         // grows with the same options, not with huge blocks
+         assert(Mem_SetHugeThreshold(0) == 0);
+         assert(Mem_Alloc(total) != NULL);
+         assert(Mem_Alloc(total / 2) != NULL);
+      }
+      exit(0);
+   }
+   assert(waitpid(pid, &status, 0) == pid);
+   assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main() {
+   struct rlimit limit;
+   FILE* file;
+   long reserved = 0;
+
+   assert(Mem_InitEx(4096, 0x1000) == -1);
+   assert(Mem_InitEx(4096, MEM_INIT_HUGETLB_2MB | MEM_INIT_THP) == -1);
+   assert(Mem_InitEx(4096, MEM_INIT_HUGETLB_2MB | MEM_INIT_HUGETLB_1GB) == -1);
+
+   run(MB, 0, 1);
+   run(MB, MEM_INIT_ANONYMOUS, 1);
+   run(MB, MEM_INIT_ANONYMOUS | MEM_INIT_POPULATE, 1);
+   run(MB, MEM_INIT_GROWABLE | MEM_INIT_ANONYMOUS, 1);
+   // rounded up to 2 MB and aligned to it
+   run(3 * MB, MEM_INIT_THP, 1);
+   run(3 * MB, MEM_INIT_THP | MEM_INIT_POPULATE | MEM_INIT_GROWABLE, 1);
+
+   // hugetlb pages have to be reserved by the system first
+   file = fopen("/proc/sys/vm/nr_hugepages", "r");
+   if (file != NULL) {
+      if (fscanf(file, "%ld", &reserved) != 1)
+         reserved = 0;
+      fclose(file);
+   }
+   if (reserved == 0)
+      run(MB, MEM_INIT_HUGETLB_2MB, 0);
+
+   assert(getrlimit(RLIMIT_MEMLOCK, &limit) == 0);
+   run(MB, MEM_INIT_LOCK, limit.rlim_cur >= 2 * MB || geteuid() == 0);
+   exit(0);
+}
@@ -0,0 +1,24 @@
+/* heap and allocation larger than 4 GB (64-bit build only) */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "mem.h"
+
+int main() {
+   if (sizeof(void*) < 8)
+      exit(0);
+
+   size_t gb = (size_t)1 << 30;
+   assert(Mem_Init(5 * gb) == 0);
+
+   char* ptr = Mem_Alloc(4 * gb + 100);
+   assert(ptr != NULL);
+   assert((uintptr_t)ptr % 8 == 0);
+   ptr[0] = 1;
+   ptr[4 * gb + 99] = 2;
+   assert(Mem_Alloc(gb) == NULL);
+
+   assert(Mem_Free(ptr) == 0);
+   assert(Mem_Alloc(5 * gb - 64) != NULL);
+   exit(0);
+}
@@ -0,0 +1,83 @@
+/* a NUMA aware heap serves every thread from the arena of its node and gives blocks freed on other nodes back to their own */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "mem.h"
+
+#define THREADS 4
+#define BLOCKS 500
+
+static int nodes[16];
+static int count;
+static char* blocks[THREADS][BLOCKS];
+
+// allocates its own row on one node
+void* producer(void* arg) {
+   int id = *(int*)arg;
+   int i;
+
+   assert(Mem_SetThreadNode(nodes[id % count]) == 0);
+   for (i = 0; i < BLOCKS; i++) {
+      blocks[id][i] = Mem_Alloc(100 + i % 400);
+      assert(blocks[id][i] != NULL);
+      memset(blocks[id][i], id, 100 + i % 400);
+   }
+   return NULL;
+}
+
+// frees the row of the next thread from another node
+void* consumer(void* arg) {
+   int id = *(int*)arg;
+   int row = (id + 1) % THREADS;
+   int i;
+
+   assert(Mem_SetThreadNode(nodes[id % count]) == 0);
+   for (i = 0; i < BLOCKS; i++) {
+      assert(blocks[row][i][99] == (char)row);
+      assert(Mem_Free(blocks[row][i]) == 0);
+   }
+   return NULL;
+}
+
+static void run(void* (*worker)(void*)) {
+   pthread_t thread[THREADS];
+   int id[THREADS];
+   int i;
+
+   for (i = 0; i < THREADS; i++) {
+      id[i] = i;
+      assert(pthread_create(&thread[i], NULL, worker, &id[i]) == 0);
+   }
+   for (i = 0; i < THREADS; i++)
+      assert(pthread_join(thread[i], NULL) == 0);
+}
+
+int main() {
+   struct mem_stats before, stats;
+   int node;
+
+   // nothing to pick before the heap is set up
+   assert(Mem_NumaNodes() == 0);
+   assert(Mem_SetThreadNode(0) == -1);
+
+   assert(Mem_InitEx(1 << 20, MEM_INIT_NUMA) == 0);
+   assert(Mem_NumaNodes() >= 1);
+   for (node = 0; node < 16; node++)
+      if (Mem_SetThreadNode(node) == 0)
+         nodes[count++] = node;
+   assert(count == Mem_NumaNodes());
+   assert(Mem_SetThreadNode(16) == -1 && Mem_SetThreadNode(-2) == -1);
+   assert(Mem_SetThreadNode(-1) == 0);
+   assert(Mem_GetStats(&before) == 0);
+
+   run(producer);
+   run(consumer);
+
+   // the blocks collected for other nodes went back when the threads exited
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.alloc_count == before.alloc_count + THREADS * BLOCKS);
+   assert(stats.free_count == before.free_count + THREADS * BLOCKS);
+   assert(stats.bytes_free == before.bytes_free);
+   exit(0);
+}
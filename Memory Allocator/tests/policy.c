@@ -0,0 +1,66 @@
+/* each placement policy picks its own block out of the same free blocks */
+#include <assert.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+static char *a, *b, *c;
+
+// free blocks of 300, 330 and 480 bytes in this order of addresses, which the
+// bins list as c, b, a since freed blocks go to the head of their bin
+static void setup() {
+   assert(Mem_Init(16384) == 0);
+   a = Mem_Alloc(300);
+   assert(Mem_Alloc(100) != NULL);
+   b = Mem_Alloc(330);
+   assert(Mem_Alloc(100) != NULL);
+   c = Mem_Alloc(480);
+   assert(Mem_Alloc(100) != NULL);
+   assert(a != NULL && b != NULL && c != NULL);
+   assert(Mem_Free(a) == 0);
+   assert(Mem_Free(b) == 0);
+   assert(Mem_Free(c) == 0);
+}
+
+static void run(int policy) {
+   char* ptr;
+
+   setup();
+   assert(Mem_SetPolicy(policy) == 0);
+   switch (policy) {
+   case MEM_BEST_FIT:
+      assert(Mem_Alloc(300) == a);
+      break;
+   case MEM_FIRST_FIT:
+      assert(Mem_Alloc(300) == c);
+      break;
+   case MEM_GOOD_FIT:
+      // b is less than 1/8 too big and comes before a
+      assert(Mem_Alloc(300) == b);
+      break;
+   case MEM_NEXT_FIT:
+      // the search goes on after the last block allocated instead of starting over at a
+      ptr = Mem_Alloc(300);
+      assert(ptr != NULL && ptr > c);
+      break;
+   }
+   exit(0);
+}
+
+int main() {
+   int policies[4] = {MEM_BEST_FIT, MEM_FIRST_FIT, MEM_GOOD_FIT, MEM_NEXT_FIT};
+   int i, status;
+
+   assert(Mem_SetPolicy(42) == -1);
+   // Mem_Init can only be called once, so every policy gets a process of its own
+   for (i = 0; i < 4; i++) {
+      pid_t pid = fork();
+      assert(pid >= 0);
+      if (pid == 0)
+         run(policies[i]);
+      assert(waitpid(pid, &status, 0) == pid);
+      assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+   }
+   exit(0);
+}
@@ -0,0 +1,129 @@
+/* with libmempreload64.so preloaded (make preload64) malloc and friends of any program come from the heap */
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define LIBRARY (sizeof(void*) == 8 ? "../libmempreload64.so" : "../libmempreload.so")
+
+static void* worker(void* arg) {
+   char* ptrs[100];
+   int i, round;
+   for (round = 0; round < 100; round++) {
+      for (i = 0; i < 100; i++) {
+         ptrs[i] = malloc(i * 16 + 1);
+         assert(ptrs[i] != NULL && Mem_UsableSize(ptrs[i]) > (size_t)i * 16);
+         memset(ptrs[i], 'a', i * 16 + 1);
+      }
+      for (i = 0; i < 100; i++)
+         free(ptrs[i]);
+   }
+   return arg;
+}
+
+// runs in a process of its own with the library preloaded
+static void child() {
+   struct mem_stats stats;
+   pthread_t threads[4];
+   char *ptr, *big;
+   void* aligned;
+   FILE* file;
+   int i;
+
+   // the allocations are blocks of the heap, which set itself up
+   ptr = malloc(100);
+   assert(ptr != NULL && Mem_UsableSize(ptr) >= 100);
+   assert(malloc_usable_size(ptr) == Mem_UsableSize(ptr));
+   strcpy(ptr, "preloaded");
+   ptr = realloc(ptr, 5000);
+   assert(ptr != NULL && strcmp(ptr, "preloaded") == 0 && Mem_UsableSize(ptr) >= 5000);
+   free(ptr);
+   free(NULL);
+   assert(malloc(0) != NULL);
+
+   ptr = calloc(1000, 4);
+   assert(ptr != NULL && Mem_UsableSize(ptr) >= 4000);
+   for (i = 0; i < 4000; i++)
+      assert(ptr[i] == 0);
+   free(ptr);
+   errno = 0;
+   assert(calloc(SIZE_MAX / 2, 4) == NULL && errno == ENOMEM);
+
+   assert(posix_memalign(&aligned, 4096, 300) == 0);
+   assert((uintptr_t)aligned % 4096 == 0 && Mem_UsableSize(aligned) >= 300);
+   free(aligned);
+   assert(posix_memalign(&aligned, 24, 300) == EINVAL);
+   aligned = aligned_alloc(64, 128);
+   assert(aligned != NULL && (uintptr_t)aligned % 64 == 0 && Mem_UsableSize(aligned) >= 128);
+   free(aligned);
+
+   // every allocation holds any type, alignof(max_align_t) is 16
+   for (i = 1; i < 200; i++) {
+      ptr = malloc(i);
+      assert(ptr != NULL && (uintptr_t)ptr % 16 == 0);
+      ptr = realloc(ptr, i * 3);
+      assert(ptr != NULL && (uintptr_t)ptr % 16 == 0);
+      free(ptr);
+      ptr = calloc(i, 1);
+      assert(ptr != NULL && (uintptr_t)ptr % 16 == 0);
+      free(ptr);
+   }
+
+   // big ones are huge blocks
+   big = malloc(1 << 20);
+   assert(big != NULL && Mem_UsableSize(big) >= 1 << 20);
+   memset(big, 'b', 1 << 20);
+   free(big);
+
+   // and the C library itself allocates from the heap
+   ptr = strdup("copy");
+   assert(ptr != NULL && Mem_UsableSize(ptr) >= 5);
+   free(ptr);
+   file = fopen("/proc/self/maps", "r");
+   assert(file != NULL);
+   assert(fclose(file) == 0);
+
+   for (i = 0; i < 4; i++)
+      assert(pthread_create(&threads[i], NULL, worker, NULL) == 0);
+   for (i = 0; i < 4; i++)
+      assert(pthread_join(threads[i], NULL) == 0);
+
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.alloc_count >= 40000 && stats.free_count >= 40000);
+   exit(0);
+}
+
+int main(int argc, char* argv[]) {
+   pid_t pid;
+   int status;
+
+   if (argc > 1 && strcmp(argv[1], "child") == 0)
+      child();
+
+   // without the library malloc is the one of the C library
+   char* ptr = malloc(100);
+   assert(ptr != NULL && Mem_UsableSize(ptr) == 0);
+   free(ptr);
+
+   assert(access(LIBRARY, R_OK) == 0);
+   assert(setenv("LD_PRELOAD", LIBRARY, 1) == 0);
+   pid = fork();
+   assert(pid >= 0);
+   if (pid == 0) {
+      execl(argv[0], argv[0], "child", (char*)NULL);
+      exit(1);
+   }
+   assert(waitpid(pid, &status, 0) == pid);
+   assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+   // programs which know nothing about the heap run on it as well
+   assert(system("ls -l / | sort > /dev/null") == 0);
+   exit(0);
+}
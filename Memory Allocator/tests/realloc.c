@@ -0,0 +1,51 @@
+/* blocks grow and shrink in place when the next block allows it and are moved otherwise */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+static int filled(char* ptr, int size, char c) {
+   int i;
+   for (i = 0; i < size; i++)
+      if (ptr[i] != c) return 0;
+   return 1;
+}
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   char *ptr, *other, *moved;
+   int x;
+
+   ptr = Mem_Alloc(100);
+   assert(ptr != NULL);
+   memset(ptr, 'a', 100);
+
+   // grows into the free rest of the heap
+   assert(Mem_Realloc(ptr, 1000) == ptr);
+   assert(filled(ptr, 100, 'a'));
+   memset(ptr, 'b', 1000);
+
+   // shrinks in place, the tail is free again right after the block
+   assert(Mem_Realloc(ptr, 200) == ptr);
+   assert(filled(ptr, 200, 'b'));
+   other = Mem_Alloc(500);
+   assert(other != NULL && other > ptr && other < ptr + 300);
+
+   // a busy next block forces a move
+   moved = Mem_Realloc(ptr, 2000);
+   assert(moved != NULL && moved != ptr);
+   assert(filled(moved, 200, 'b'));
+   assert(Mem_Free(ptr) == -1);
+
+   // too big, the block is left alone
+   assert(Mem_Realloc(moved, 100000) == NULL);
+   assert(filled(moved, 200, 'b'));
+
+   assert(Mem_Realloc(&x, 10) == NULL);
+   ptr = Mem_Realloc(NULL, 50);
+   assert(ptr != NULL);
+   assert(Mem_Realloc(ptr, 0) == NULL);
+   assert(Mem_Free(other) == 0);
+   assert(Mem_Free(moved) == 0);
+   exit(0);
+}
@@ -0,0 +1,43 @@
+/* every chunk of every arena shares one address range table of MEM_MAX_REGIONS entries */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+static mem_arena* arenas[MEM_MAX_REGIONS];
+static void* ptrs[MEM_MAX_REGIONS];
+
+int main() {
+   assert(Mem_InitGrowable(4096) == 0);
+   void* chunks[8];
+   void* again;
+   int count, i;
+
+   // a growing heap maps a few chunks, big blocks included
+   assert(Mem_SetHugeThreshold(0) == 0);
+   for (i = 0; i < 8; i++) {
+      chunks[i] = Mem_Alloc(4096 << i);
+      assert(chunks[i] != NULL);
+   }
+
+   // and leaves all other entries to the arenas
+   for (count = 0; count < MEM_MAX_REGIONS; count++) {
+      arenas[count] = Mem_ArenaCreate(4096);
+      if (arenas[count] == NULL) break;
+      ptrs[count] = Mem_ArenaAlloc(arenas[count], 100);
+      assert(ptrs[count] != NULL);
+   }
+   assert(count < MEM_MAX_REGIONS && count >= MEM_MAX_REGIONS - 16);
+
+   // a full table only stops new chunks, Mem_Free finds the arena of any pointer
+   assert(Mem_Alloc(1 << 20) == NULL);
+   for (i = 0; i < count; i++)
+      assert(Mem_Free(ptrs[i]) == 0 && Mem_Free(ptrs[i]) == -1);
+   for (i = 7; i >= 0; i--)
+      assert(Mem_Free(chunks[i]) == 0);
+
+   // the entries of the unmapped chunks are taken again
+   again = Mem_Alloc(1 << 20);
+   assert(again != NULL && Mem_Free(again) == 0);
+   assert(Mem_Free(chunks[7]) == -1);
+   exit(0);
+}
@@ -0,0 +1,66 @@
+/* frees from other threads while the heap is busy are left to the next holder of the lock and coalesce like any other */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "mem.h"
+
+#define THREADS 4
+#define ROUNDS 50
+#define BLOCKS 100
+
+static char* blocks[THREADS][BLOCKS];
+static pthread_barrier_t barrier;
+
+// allocates its own row, then frees the row of the next thread while the others do the same
+void* worker(void* arg) {
+   int id = *(int*)arg;
+   int row = (id + 1) % THREADS;
+   int i, j;
+
+   for (i = 0; i < ROUNDS; i++) {
+      for (j = 0; j < BLOCKS; j++) {
+         blocks[id][j] = Mem_Alloc(100 + (i + j) % 300);
+         assert(blocks[id][j] != NULL);
+         memset(blocks[id][j], id, 100 + (i + j) % 300);
+      }
+      pthread_barrier_wait(&barrier);
+      for (j = 0; j < BLOCKS; j++) {
+         assert(blocks[row][j][99] == (char)row);
+         assert(Mem_Free(blocks[row][j]) == 0);
+      }
+      pthread_barrier_wait(&barrier);
+   }
+   return NULL;
+}
+
+int main() {
+   assert(Mem_Init(1 << 20) == 0);
+   struct mem_stats before, stats;
+   pthread_t thread[THREADS];
+   int id[THREADS];
+   void* ptr;
+   int i;
+
+   assert(Mem_GetStats(&before) == 0);
+   assert(pthread_barrier_init(&barrier, NULL, THREADS) == 0);
+   for (i = 0; i < THREADS; i++) {
+      id[i] = i;
+      assert(pthread_create(&thread[i], NULL, worker, &id[i]) == 0);
+   }
+   for (i = 0; i < THREADS; i++)
+      assert(pthread_join(thread[i], NULL) == 0);
+
+   // asking for the stats frees what is left over, every free counts once
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.alloc_count == before.alloc_count + THREADS * ROUNDS * BLOCKS);
+   assert(stats.free_count == before.free_count + THREADS * ROUNDS * BLOCKS);
+   assert(stats.remote_frees <= THREADS * ROUNDS * BLOCKS);
+   assert(stats.bytes_free == before.bytes_free);
+
+   // and all of it coalesced again
+   ptr = Mem_Alloc(before.largest_free - 64);
+   assert(ptr != NULL);
+   assert(Mem_Free(ptr) == 0);
+   exit(0);
+}
@@ -0,0 +1,70 @@
+/* a scratch arena bumps through big pieces of the heap and gives them back all at once on rewind, reset and end */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(1 << 20) == 0);
+   struct mem_stats before, stats;
+   mem_scratch* scratch;
+   mem_scratch_mark mark;
+   char *ptr, *prev = NULL, *big;
+   int i;
+
+   assert(Mem_GetStats(&before) == 0);
+   scratch = Mem_ScratchBegin(4096);
+   assert(scratch != NULL);
+   assert(Mem_ScratchAlloc(scratch, 0) == NULL);
+
+   // bumped through the first piece without touching the heap
+   for (i = 0; i < 50; i++) {
+      ptr = Mem_ScratchAlloc(scratch, 1 + i % 30);
+      assert(ptr != NULL && (uintptr_t)ptr % sizeof(void*) == 0);
+      assert(prev == NULL || ptr >= prev + 1 + (i - 1) % 30);
+      memset(ptr, 'a', 1 + i % 30);
+      prev = ptr;
+   }
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.alloc_count == before.alloc_count + 1);
+
+   // more pieces are taken as needed, at least as big as the request
+   mark = Mem_ScratchMark(scratch);
+   for (i = 0; i < 100; i++) {
+      ptr = Mem_ScratchAlloc(scratch, 100);
+      assert(ptr != NULL);
+      memset(ptr, 'b', 100);
+   }
+   big = Mem_ScratchAlloc(scratch, 20000);
+   assert(big != NULL);
+   memset(big, 'c', 20000);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.alloc_count >= before.alloc_count + 4 && stats.alloc_count <= before.alloc_count + 6);
+
+   // rewinding gives those pieces back and reuses the room after the mark
+   Mem_ScratchRewind(scratch, mark);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.free_count == stats.alloc_count - 1 - before.alloc_count + before.free_count);
+   ptr = Mem_ScratchAlloc(scratch, 8);
+   assert(ptr == mark.next);
+
+   for (i = 0; i < 100; i++)
+      assert(Mem_ScratchAlloc(scratch, 500) != NULL);
+   Mem_ScratchReset(scratch);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.free_count == stats.alloc_count - 1 - before.alloc_count + before.free_count);
+
+   // ending it leaves the heap as it was
+   Mem_ScratchEnd(scratch);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.bytes_free == before.bytes_free);
+
+   // too much for the heap
+   scratch = Mem_ScratchBegin(0);
+   assert(scratch != NULL);
+   assert(Mem_ScratchAlloc(scratch, 2 << 20) == NULL);
+   assert(Mem_ScratchAlloc(scratch, 100) != NULL);
+   Mem_ScratchEnd(scratch);
+   exit(0);
+}
@@ -0,0 +1,94 @@
+/* a heap in shared memory is used by two processes at once, which pass blocks to each other as offsets */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define ROUNDS 20000
+
+static char name[64];
+
+// allocates and frees in the shared heap while the other process does the same
+static void churn(mem_arena* arena, int id) {
+   void* ptr[16] = {0};
+   int i;
+
+   for (i = 0; i < ROUNDS; i++) {
+      int slot = (i * 7 + id) % 16;
+      if (ptr[slot] != NULL)
+         assert(Mem_ArenaFree(arena, ptr[slot]) == 0);
+      ptr[slot] = Mem_ArenaAlloc(arena, 8 + (i * 13 + id) % 2000);
+      assert(ptr[slot] != NULL);
+      memset(ptr[slot], id, 8);
+   }
+   for (i = 0; i < 16; i++)
+      assert(Mem_ArenaFree(arena, ptr[i]) == 0);
+}
+
+int main() {
+   struct mem_stats before, stats;
+   int ready[2], back[2];
+   mem_arena* arena;
+   size_t offset;
+   char* message;
+   int status;
+   char c;
+
+   snprintf(name, sizeof(name), "/mem_shm_%d", (int)getpid());
+   assert(pipe(ready) == 0 && pipe(back) == 0);
+
+   // forked before the heap exists, so the child has to attach to it
+   pid_t pid = fork();
+   assert(pid >= 0);
+   if (pid == 0) {
+      assert(read(ready[0], &c, 1) == 1);
+      arena = Mem_ShmAttach(name);
+      assert(arena != NULL);
+      message = Mem_ArenaAlloc(arena, 100000);
+      assert(message != NULL);
+      strcpy(message, "hello from the child");
+      offset = Mem_ArenaOffset(arena, message);
+      assert(write(back[1], &offset, sizeof(offset)) == sizeof(offset));
+      churn(arena, 1);
+      assert(Mem_ShmDetach(arena) == 0);
+      exit(0);
+   }
+
+   assert(Mem_ShmAttach(name) == NULL);
+   arena = Mem_ShmCreate(name, 1 << 20);
+   assert(arena != NULL);
+   assert(Mem_ShmCreate(name, 1 << 20) == NULL);
+   assert(Mem_ArenaGetStats(arena, &before) == 0);
+   assert(write(ready[1], "x", 1) == 1);
+
+   // the message arrives without being copied, and is freed here
+   assert(read(back[0], &offset, sizeof(offset)) == sizeof(offset));
+   message = Mem_ArenaPointer(arena, offset);
+   assert(message != NULL && strcmp(message, "hello from the child") == 0);
+   assert(Mem_ArenaOffset(arena, message) == offset);
+   assert(Mem_Free(message) == 0);
+   churn(arena, 2);
+
+   assert(waitpid(pid, &status, 0) == pid);
+   assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+   assert(Mem_ArenaGetStats(arena, &stats) == 0);
+   assert(stats.alloc_count == before.alloc_count + 2 * ROUNDS + 1);
+   assert(stats.free_count == before.free_count + 2 * ROUNDS + 1);
+   assert(stats.bytes_free == before.bytes_free);
+
+   // the pages of a shared heap stay in the object, trimming gives nothing back
+   assert(Mem_ArenaTrim(arena) == 0);
+   assert(Mem_ArenaGetStats(arena, &stats) == 0);
+   assert(stats.bytes_trimmed == 0 && stats.trim_count == 0);
+
+   assert(Mem_ArenaOffset(arena, &stats) == (size_t)-1);
+   assert(Mem_ArenaPointer(arena, 1 << 21) == NULL);
+   assert(Mem_ShmDetach(Mem_ArenaCreate(4096)) == -1);
+   assert(Mem_ShmDetach(arena) == 0);
+   assert(shm_unlink(name) == 0);
+   exit(0);
+}
@@ -0,0 +1,37 @@
+/* many small allocations are packed into slabs and the slabs are given back once empty */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define COUNT 3000
+
+int main() {
+   assert(Mem_Init(65536) == 0);
+   static char* ptr[COUNT];
+   int i;
+
+   // with a header per block these would not fit into the heap of the 64-bit build
+   for (i = 0; i < COUNT; i++) {
+      ptr[i] = Mem_Alloc(16);
+      assert(ptr[i] != NULL);
+      assert((uintptr_t)ptr[i] % sizeof(void*) == 0);
+      memset(ptr[i], i & 0xff, 16);
+   }
+   for (i = 0; i < COUNT; i++) {
+      assert(ptr[i][0] == (char)(i & 0xff));
+      assert(ptr[i][15] == (char)(i & 0xff));
+   }
+
+   // pointers into the middle of a slot cannot be freed
+   assert(Mem_Free(ptr[0] + 4) == -1);
+
+   for (i = 0; i < COUNT; i++) {
+      assert(Mem_Free(ptr[i]) == 0);
+   }
+
+   // all slabs are empty again, so the heap has room for one big block
+   assert(Mem_Alloc(60000) != NULL);
+   exit(0);
+}
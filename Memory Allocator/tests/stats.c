@@ -0,0 +1,46 @@
+/* live counters of the heap follow allocations, frees and failed allocations */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   struct mem_stats before, stats;
+   size_t searches = 0;
+   int i;
+
+   assert(Mem_GetStats(NULL) == -1);
+   assert(Mem_GetStats(&before) == 0);
+   assert(before.alloc_count == 0 && before.free_count == 0 && before.failed_allocs == 0);
+   assert(before.bytes_free >= 4000);
+   assert(before.largest_free == before.bytes_free);
+
+   void* ptr[3];
+   ptr[0] = Mem_Alloc(200);
+   ptr[1] = Mem_Alloc(100);
+   ptr[2] = Mem_Alloc(8);
+   assert(ptr[0] != NULL && ptr[1] != NULL && ptr[2] != NULL);
+   assert(Mem_Alloc(100000) == NULL);
+   // requests of 0 bytes do not count as failed
+   assert(Mem_Alloc(0) == NULL);
+
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.alloc_count == 3);
+   assert(stats.failed_allocs == 1);
+   assert(stats.free_count == 0);
+   assert(stats.bytes_busy + stats.bytes_free == before.bytes_busy + before.bytes_free);
+   assert(stats.bytes_busy >= before.bytes_busy + 308);
+   assert(stats.largest_free <= stats.bytes_free);
+   for (i = 0; i < MEM_STATS_VISIT_BUCKETS; i++)
+      searches += stats.visits[i];
+   assert(searches >= 2);
+
+   before = stats;
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_Free(ptr[0] + 1) == -1);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.free_count == 1);
+   assert(stats.bytes_free >= before.bytes_free + 200);
+   assert(stats.largest_free >= before.largest_free);
+   exit(0);
+}
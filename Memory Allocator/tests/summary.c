@@ -0,0 +1,48 @@
+/* the heap summary counts free blocks by size range and agrees with the live counters */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   void* ptr[10];
+   struct mem_stats stats;
+   char line[256];
+   size_t free_blocks = 0, largest = 0;
+   int i, has_map = 0;
+
+   for (i = 0; i < 10; i++) {
+      ptr[i] = Mem_Alloc(200);
+      assert(ptr[i] != NULL);
+   }
+   // five free blocks between busy ones, plus the rest of the heap
+   for (i = 0; i < 10; i += 2)
+      assert(Mem_Free(ptr[i]) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+
+   // capture the summary
+   FILE* out = tmpfile();
+   assert(out != NULL);
+   int saved = dup(1);
+   fflush(stdout);
+   dup2(fileno(out), 1);
+   Mem_DumpSummary();
+   dup2(saved, 1);
+
+   rewind(out);
+   while (fgets(line, sizeof(line), out) != NULL) {
+      sscanf(line, "Free blocks = %zu", &free_blocks);
+      sscanf(line, "Largest free block = %zu", &largest);
+      if (strncmp(line, "Map = [", 7) == 0) {
+         has_map = 1;
+         assert(strchr(line, '+') != NULL);
+      }
+   }
+   assert(free_blocks == 6);
+   assert(largest == stats.largest_free);
+   assert(has_map);
+   exit(0);
+}
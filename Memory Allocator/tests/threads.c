@@ -0,0 +1,48 @@
+/* small allocations and frees from several threads at once */
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "mem.h"
+
+#define THREADS 4
+#define ROUNDS 2000
+#define SLOTS 32
+
+void* worker(void* arg) {
+   int id = *(int*)arg;
+   char* ptr[SLOTS];
+   int i, j, k;
+
+   for (i = 0; i < ROUNDS; i++) {
+      for (j = 0; j < SLOTS; j++) {
+         ptr[j] = Mem_Alloc(1 + (i + j) % 40);
+         assert(ptr[j] != NULL);
+         for (k = 0; k < 1 + (i + j) % 40; k++)
+            ptr[j][k] = (char)(id + j);
+      }
+      for (j = 0; j < SLOTS; j++) {
+         for (k = 0; k < 1 + (i + j) % 40; k++)
+            assert(ptr[j][k] == (char)(id + j));
+         assert(Mem_Free(ptr[j]) == 0);
+      }
+   }
+   return NULL;
+}
+
+int main() {
+   assert(Mem_Init(65536) == 0);
+   pthread_t thread[THREADS];
+   int id[THREADS];
+   int i;
+
+   for (i = 0; i < THREADS; i++) {
+      id[i] = i;
+      assert(pthread_create(&thread[i], NULL, worker, &id[i]) == 0);
+   }
+   for (i = 0; i < THREADS; i++)
+      assert(pthread_join(thread[i], NULL) == 0);
+
+   // the caches of the exited threads went back to the heap
+   assert(Mem_Alloc(65536 - 64) != NULL);
+   exit(0);
+}
@@ -0,0 +1,129 @@
+/* a trace records the allocations and frees of every thread in order and drops what does not fit */
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+static struct mem_trace_event events[64];
+
+// reads the trace at 'path' into 'events', returns the number of events
+static int read_trace(const char* path, struct mem_trace_header* header) {
+   FILE* file = fopen(path, "rb");
+   int count;
+   assert(file != NULL);
+   assert(fread(header, sizeof(*header), 1, file) == 1);
+   assert(memcmp(header->magic, MEM_TRACE_MAGIC, 8) == 0);
+   assert(header->version == MEM_TRACE_VERSION);
+   assert(header->event_size == sizeof(struct mem_trace_event));
+   count = fread(events, sizeof(events[0]), 64, file);
+   fclose(file);
+   return count;
+}
+
+static void* worker(void* arg) {
+   void* ptr[5];
+   int i;
+   for (i = 0; i < 5; i++)
+      assert((ptr[i] = Mem_Alloc(300)) != NULL);
+   for (i = 0; i < 5; i++)
+      assert(Mem_Free(ptr[i]) == 0);
+   return arg;
+}
+
+static pthread_barrier_t barrier;
+
+// records its events and stays alive until the trace is stopped
+static void* live_worker(void* arg) {
+   int i;
+   for (i = 0; i < 3; i++)
+      assert(Mem_Free(Mem_Alloc(700)) == 0);
+   pthread_barrier_wait(&barrier);
+   pthread_barrier_wait(&barrier);
+   return arg;
+}
+
+int main() {
+   assert(Mem_Init(1 << 20) == 0);
+   char path[] = "/tmp/mem_traceXXXXXX";
+   struct mem_trace_header header;
+   pthread_t thread;
+   char *a, *b, *c;
+   int count, i;
+
+   int fd = mkstemp(path);
+   assert(fd != -1);
+   close(fd);
+
+   assert(Mem_TraceStop() == -1);
+   assert(Mem_TraceStart(path, 0) == -1);
+   assert(Mem_TraceStart(path, 100) == 0);
+   assert(Mem_TraceStart(path, 100) == -1);
+
+   a = Mem_Alloc(100);
+   b = Mem_Alloc(20);
+   assert(a != NULL && b != NULL);
+   c = Mem_Realloc(b, 2000);
+   assert(c != NULL);
+   assert(Mem_Free(a) == 0);
+   assert(Mem_Free(a) == -1);
+   assert(Mem_Free(c) == 0);
+
+   // the buffer of the thread is written when it exits
+   assert(pthread_create(&thread, NULL, worker, NULL) == 0);
+   assert(pthread_join(thread, NULL) == 0);
+   assert(Mem_TraceStop() == 0);
+
+   count = read_trace(path, &header);
+   assert(count == 15 && header.dropped == 0);
+   // the worker wrote its events first, the events of this thread were written at Mem_TraceStop
+   for (i = 0; i < 10; i++) {
+      assert(events[i].thread == events[0].thread && events[i].thread != events[10].thread);
+      assert(events[i].op == (i < 5 ? MEM_TRACE_ALLOC : MEM_TRACE_FREE));
+      assert(events[i].ptr == events[i % 5].ptr);
+   }
+   for (i = 11; i < count; i++)
+      assert(events[i].thread == events[10].thread && events[i].time >= events[i - 1].time);
+
+   assert(events[10].op == MEM_TRACE_ALLOC && events[10].ptr == (uintptr_t)a && events[10].size == 100);
+   assert(events[11].op == MEM_TRACE_ALLOC && events[11].ptr == (uintptr_t)b && events[11].size == 20);
+   assert(events[12].op == MEM_TRACE_REALLOC && events[12].ptr == (uintptr_t)c);
+   assert(events[12].old == (uintptr_t)b && events[12].size == 2000);
+   assert(events[13].op == MEM_TRACE_FREE && events[13].ptr == (uintptr_t)a);
+   assert(events[14].op == MEM_TRACE_FREE && events[14].ptr == (uintptr_t)c);
+
+   // a small file keeps the first events and counts the rest
+   assert(Mem_TraceStart(path, 3) == 0);
+   for (i = 0; i < 5; i++)
+      assert(Mem_Free(Mem_Alloc(500)) == 0);
+   assert(Mem_TraceStop() == 0);
+   count = read_trace(path, &header);
+   assert(count == 3 && header.dropped == 7);
+   assert(events[0].op == MEM_TRACE_ALLOC && events[0].size == 500);
+   assert(events[1].op == MEM_TRACE_FREE && events[1].ptr == events[0].ptr);
+
+   // the buffers of threads which are still running are written as well
+   assert(pthread_barrier_init(&barrier, NULL, 2) == 0);
+   assert(Mem_TraceStart(path, 100) == 0);
+   assert(pthread_create(&thread, NULL, live_worker, NULL) == 0);
+   pthread_barrier_wait(&barrier);
+   assert(Mem_TraceStop() == 0);
+   pthread_barrier_wait(&barrier);
+   assert(pthread_join(thread, NULL) == 0);
+   count = read_trace(path, &header);
+   assert(count == 6 && header.dropped == 0);
+   for (i = 0; i < count; i++) {
+      assert(events[i].op == (i % 2 == 0 ? MEM_TRACE_ALLOC : MEM_TRACE_FREE));
+      assert(events[i].ptr == events[i - i % 2].ptr);
+   }
+   assert(events[0].size == 700);
+
+   // nothing is recorded without a trace
+   assert(Mem_Free(Mem_Alloc(500)) == 0);
+   assert(read_trace(path, &header) == 6);
+
+   unlink(path);
+   exit(0);
+}
@@ -0,0 +1,30 @@
+/* many large free blocks of different sizes - every allocation takes the exact best fit */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+#define COUNT 500
+
+int main() {
+   assert(Mem_Init(4 << 20) == 0);
+   static char* ptr[COUNT];
+   int i;
+
+   // free blocks of 300, 316, 332, ... bytes kept apart by busy blocks
+   for (i = 0; i < COUNT; i++) {
+      ptr[i] = Mem_Alloc(300 + 16 * i);
+      assert(ptr[i] != NULL);
+      assert(Mem_Alloc(100) != NULL);
+   }
+   for (i = 0; i < COUNT; i++)
+      assert(Mem_Free(ptr[(i * 7) % COUNT]) == 0);
+
+   // exact fits, taken in an order unrelated to the one they were freed in
+   for (i = 0; i < COUNT; i += 3)
+      assert(Mem_Alloc(300 + 16 * i) == ptr[i]);
+
+   // a little less than a free block still gets that block, not a bigger one
+   for (i = 1; i < COUNT; i += 3)
+      assert(Mem_Alloc(300 + 16 * i - 8) == ptr[i]);
+   exit(0);
+}
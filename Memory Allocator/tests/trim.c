@@ -0,0 +1,72 @@
+/* trimming gives the pages inside free blocks back to the system, on request or once enough has been freed */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "mem.h"
+
+// 1 if all whole pages inside [ptr, ptr + size) are resident, 0 if none of them is, -1 otherwise
+static int resident(char* ptr, size_t size) {
+   size_t pagesize = getpagesize();
+   uintptr_t start = ((uintptr_t)ptr + pagesize - 1) & ~(pagesize - 1);
+   uintptr_t end = ((uintptr_t)ptr + size) & ~(pagesize - 1);
+   size_t pages = (end - start) / pagesize, count = 0, i;
+   unsigned char vec[4096];
+   assert(pages <= sizeof(vec));
+   assert(mincore((void*)start, end - start, vec) == 0);
+   for (i = 0; i < pages; i++)
+      count += vec[i] & 1;
+   return count == pages ? 1 : count == 0 ? 0 : -1;
+}
+
+int main() {
+   size_t mb = 1 << 20;
+   assert(Mem_Init(16 * mb) == 0);
+   struct mem_stats stats;
+   size_t released;
+   char *big, *small;
+
+   big = Mem_Alloc(8 * mb);
+   assert(big != NULL);
+   memset(big, 'a', 8 * mb);
+   assert(resident(big, 8 * mb) == 1);
+
+   // freeing alone keeps the pages
+   assert(Mem_Free(big) == 0);
+   assert(resident(big, 8 * mb) == 1);
+
+   released = Mem_Trim();
+   assert(released >= 8 * mb);
+   assert(resident(big, 8 * mb) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.trim_count == 1 && stats.bytes_trimmed == released);
+
+   // pages trimmed before are not given back again
+   assert(Mem_Trim() == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.trim_count == 2 && stats.bytes_trimmed == released);
+
+   // the memory is still usable, and reads as zeroes
+   big = Mem_Alloc(8 * mb);
+   assert(big != NULL && big[4 * mb] == 0);
+   memset(big, 'b', 8 * mb);
+
+   // small frees stay below the threshold
+   assert(Mem_SetTrimThreshold(4 * mb) == 0);
+   small = Mem_Alloc(mb);
+   assert(small != NULL);
+   memset(small, 'c', mb);
+   assert(Mem_Free(small) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.trim_count == 2);
+   assert(resident(small, mb) == 1);
+
+   // the big one reaches it and the heap trims itself
+   assert(Mem_Free(big) == 0);
+   assert(Mem_GetStats(&stats) == 0);
+   assert(stats.trim_count == 3 && stats.bytes_trimmed >= released + 9 * mb);
+   assert(resident(big, 8 * mb) == 0 && resident(small, mb) == 0);
+   exit(0);
+}